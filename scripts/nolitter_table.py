@@ -39,19 +39,27 @@ filenames = [
 
 aggregate = statistics.median
 
-def parse_perf_counter(name, line):
-    return int(re.match(f"\s*(\S+)\s*{name}", line).group(1).replace(",", ""))
+def parse_perf_counter(line):
+    """The (event, count) of a perf stat line, or None."""
+    match = re.match("([\d,]+)\s+(\S+)", line)
+    return (match.group(2), int(match.group(1).replace(",", ""))) if match else None
 
 
 def parse_run(lines, index):
+    """Parses the run starting at the `Time elapsed` line at `index`, up to the next one. Counters are found by their
+    event name, not by their line, since the litterer may report more after the elapsed time."""
     run = {}
-    assert(re.match("Time elapsed", lines[index]))
-    run["elapsed"] = float(re.match("Time elapsed\s*:\s*(.+)", lines[index]).group(1))
+    match = re.match("Time elapsed\s*:\s*(.+)", lines[index])
+    assert(match)
+    run["elapsed"] = float(match.group(1))
 
-    for i in range(len(EVENTS)):
-        run[EVENTS[i]] = parse_perf_counter(EVENTS[i], lines[index + 5 + i])
+    end = index + 1
+    while end < len(lines) and not lines[end].startswith("Time elapsed"):
+        if (counter := parse_perf_counter(lines[end])) and counter[0] in EVENTS:
+            run[counter[0]] = counter[1]
+        end += 1
 
-    return index + 32, run
+    return end, run
 
 
 def parse_runs(filename):
@@ -111,23 +111,35 @@ benchmarks = [
 ]
 
 
-def parse_perf_counter(name, line):
-    return re.match(f"\s*(\S+)\s*{name}", line).group(1).replace(",", "")
+HEADER = re.compile("=+\s*Litterer\s*=+$")
+
+
+def parse_perf_counter(line):
+    """The (event, count) of a perf stat line, or None."""
+    match = re.match("([\d,]+)\s+(\S+)", line)
+    return (match.group(2), match.group(1).replace(",", "")) if match else None
 
 
 def parse_run(lines, index):
+    """Parses the run whose litterer header starts at `index`, up to the next header. Fields are found by their key, not
+    by their line, since the log only shows the settings and reports that a run enables."""
     run = {}
-    assert(re.match("=+\s*Litterer\s*=+$", lines[index]))
-    
-    # Assuming shuffle, multiplier, sleep, timestamp, and malloc are constant.
-    run["seed"] = re.match("seed\s*:\s*(.+)$", lines[index + 2]).group(1)
-    run["occupancy"] = re.match("occupancy\s*:\s*(.+)", lines[index + 3]).group(1)
-    run["elapsed"] = re.match("Time elapsed\s*:\s*(.+)", lines[index + 14]).group(1)
+    assert(HEADER.match(lines[index]))
 
-    for i in range(len(EVENTS)):
-        run[EVENTS[i]] = parse_perf_counter(EVENTS[i], lines[index + 17 + i])   
+    end = index + 1
+    while end < len(lines) and not HEADER.match(lines[end]):
+        end += 1
 
-    return index + 36, run
+    # Assuming shuffle, multiplier, sleep, timestamp, and malloc are constant.
+    for line in lines[index + 1 : end]:
+        if match := re.match("(seed|occupancy)\s*:\s*(.+)$", line):
+            run.setdefault(match.group(1), match.group(2))
+        elif match := re.match("Time elapsed\s*:\s*(.+)", line):
+            run["elapsed"] = match.group(1)
+        elif (counter := parse_perf_counter(line)) and counter[0] in EVENTS:
+            run[counter[0]] = counter[1]
+
+    return end, run
 
 
 def parse_runs(filename):
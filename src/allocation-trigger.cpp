@@ -0,0 +1,91 @@
+#include "allocation-trigger.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+
+#include <dlfcn.h>
+
+namespace {
+using MallocFunction = void* (*)(std::size_t);
+
+std::atomic_bool armed{false};
+std::atomic_int64_t remaining{0};
+std::atomic<void (*)()> pendingCallback{nullptr};
+// Process-wide rather than per thread, since littering also allocates from threads of its own.
+std::atomic_int ignoring{0};
+
+std::atomic_bool recording{false};
+std::atomic_uint64_t nRecorded{0};
+std::uintptr_t* recordBuffer = nullptr;
+std::size_t* recordSizes = nullptr;
+std::uint64_t recordCapacity = 0;
+
+MallocFunction nextMalloc() {
+    static const auto next = reinterpret_cast<MallocFunction>(dlsym(RTLD_NEXT, "malloc"));
+    return next;
+}
+
+[[gnu::noinline]] void countAllocation() {
+    if (ignoring.load(std::memory_order_relaxed) || remaining.fetch_sub(1, std::memory_order_relaxed) != 1) {
+        return;
+    }
+
+    armed.store(false, std::memory_order_relaxed);
+    if (const auto callback = pendingCallback.exchange(nullptr)) {
+        // The callback allocates too, which must neither count nor trigger it again.
+        ignoreAllocations(true);
+        callback();
+        ignoreAllocations(false);
+    }
+}
+
+[[gnu::noinline]] void recordAllocation(void* pointer, std::size_t size) {
+    if (ignoring.load(std::memory_order_relaxed)) {
+        return;
+    }
+    const auto i = nRecorded.fetch_add(1, std::memory_order_relaxed);
+    if (i < recordCapacity) {
+        recordBuffer[i] = reinterpret_cast<std::uintptr_t>(pointer);
+        recordSizes[i] = size;
+    } else {
+        recording.store(false, std::memory_order_relaxed);
+    }
+}
+} // namespace
+
+extern "C" void recordAllocations(std::uintptr_t* addresses, std::size_t* sizes, std::uint64_t capacity) {
+    recording.store(false);
+    recordBuffer = addresses;
+    recordSizes = sizes;
+    recordCapacity = capacity;
+    nRecorded.store(0);
+    recording.store(true);
+}
+
+extern "C" std::uint64_t recordedAllocations() {
+    return std::min(nRecorded.load(), recordCapacity);
+}
+
+extern "C" void ignoreAllocations(bool ignore) {
+    ignoring.fetch_add(ignore ? 1 : -1);
+}
+
+extern "C" void litterOnAllocation(std::uint64_t n, void (*callback)()) {
+    armed.store(false);
+    pendingCallback.store(callback);
+    remaining.store(static_cast<std::int64_t>(n ? n : 1));
+    armed.store(true);
+}
+
+// Costs two relaxed loads per allocation once the trigger has fired and recording is done.
+extern "C" void* malloc(std::size_t size) {
+    if (armed.load(std::memory_order_relaxed)) [[unlikely]] {
+        countAllocation();
+    }
+    void* pointer = nextMalloc()(size);
+    if (recording.load(std::memory_order_relaxed)) [[unlikely]] {
+        recordAllocation(pointer, size);
+    }
+    return pointer;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Calls `callback` from within malloc, on the program thread making the `n`th malloc call from now (n >= 1), before
+// that allocation is served. Only liblitterer-trigger.so defines this, by interposing malloc: liblitterer.so leaves the
+// program's malloc path untouched, and sees a null pointer here. Arming it again replaces the pending callback. Safe to
+// call from any thread, but not from a signal handler.
+extern "C" __attribute__((weak)) void litterOnAllocation(std::uint64_t n, void (*callback)());
+
+// Stores the addresses returned by the program's next `capacity` malloc calls into `addresses`, and their requested
+// sizes into `sizes`, without allocating. Allocations made while littering (see ignoreAllocations) are left out. Also
+// only defined by liblitterer-trigger.so.
+extern "C" __attribute__((weak)) void recordAllocations(std::uintptr_t* addresses, std::size_t* sizes,
+                                                        std::uint64_t capacity);
+
+// How many allocations have been stored since recordAllocations.
+extern "C" __attribute__((weak)) std::uint64_t recordedAllocations();
+
+// While ignoring, the allocations of every thread are neither counted by litterOnAllocation nor stored by
+// recordAllocations, so that those of the litterer's producer and consumer threads are not taken for the program's.
+// Calls nest: each ignoreAllocations(true) is ended by an ignoreAllocations(false). A litterOnAllocation callback runs
+// while ignoring. Also only defined by liblitterer-trigger.so.
+extern "C" __attribute__((weak)) void ignoreAllocations(bool ignore);
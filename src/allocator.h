@@ -0,0 +1,203 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#if !_WIN32
+#include <dlfcn.h>
+#endif
+
+#if !_WIN32
+// The malloc being littered. When it is defined in the same object as the litterer, it is a hook that forwards to the
+// next malloc (liblitterer-trigger.so), so look past it.
+inline void* mallocAddress() {
+    Dl_info mallocInfo;
+    Dl_info ownInfo;
+    if (dladdr((void*) &malloc, &mallocInfo) && dladdr((void*) &mallocAddress, &ownInfo)
+        && mallocInfo.dli_fbase == ownInfo.dli_fbase) {
+        if (void* next = dlsym(RTLD_NEXT, "malloc")) {
+            return next;
+        }
+    }
+    return (void*) &malloc;
+}
+#endif
+
+// Hooks into the allocator that provides malloc, when it is one we know: jemalloc (mallctl), glibc (mallinfo2,
+// malloc_trim, mallopt) or mimalloc (mi_collect). A hook is only used if the object exporting it also provides malloc,
+// so that glibc's functions are not called in place of those of a preloaded allocator.
+class Allocator {
+  public:
+    Allocator() {
+#if !_WIN32
+        Dl_info mallocInfo;
+        if (!dladdr(mallocAddress(), &mallocInfo)) {
+            return;
+        }
+        const auto lookup = [&](const char* name) -> void* {
+            void* symbol = dlsym(RTLD_DEFAULT, name);
+            Dl_info info;
+            return symbol && dladdr(symbol, &info) && info.dli_fbase == mallocInfo.dli_fbase ? symbol : nullptr;
+        };
+
+        if (void* symbol = lookup("mallctl")) {
+            mallctl = reinterpret_cast<Mallctl>(symbol);
+            name = "jemalloc";
+        } else if (void* symbol = lookup("mi_collect")) {
+            miCollect = reinterpret_cast<MiCollect>(symbol);
+            name = "mimalloc";
+        } else if (void* symbol = lookup("mallinfo2")) {
+            mallinfo2 = reinterpret_cast<Mallinfo2>(symbol);
+            mallocTrim = reinterpret_cast<MallocTrim>(lookup("malloc_trim"));
+            mallopt = reinterpret_cast<Mallopt>(lookup("mallopt"));
+            name = "glibc";
+        }
+        mallocUsableSize = reinterpret_cast<MallocUsableSize>(lookup("malloc_usable_size"));
+#endif
+    }
+
+    // Null if the allocator is not one we know.
+    const char* source() const {
+        return name;
+    }
+
+    bool reportsFragmentation() const {
+        return mallctl || mallinfo2;
+    }
+
+    bool reportsUsableSizes() const {
+        return mallocUsableSize;
+    }
+
+    std::size_t usableSize(void* pointer) const {
+        return mallocUsableSize(pointer);
+    }
+
+    // Bytes the allocator holds over the bytes allocated from it, or 0 if it does not report them.
+    double fragmentation() const {
+        if (mallctl) {
+            refreshStatistics();
+            const auto allocated = statistic("stats.allocated");
+            return allocated ? static_cast<double>(statistic("stats.resident")) / allocated : 0;
+        }
+        if (mallinfo2) {
+            // Memory mapped chunks (hblkhd) are held and in use alike.
+            const auto info = mallinfo2();
+            const double used = info.uordblks + info.hblkhd;
+            return used ? (info.arena + info.hblkhd) / used : 0;
+        }
+        return 0;
+    }
+
+    // Bytes in the allocator's active pages (jemalloc's stats.active) or in use (glibc), or -1 if it does not report
+    // them.
+    std::int64_t activeBytes() const {
+        if (mallctl) {
+            refreshStatistics();
+            return static_cast<std::int64_t>(statistic("stats.active"));
+        }
+        if (mallinfo2) {
+            const auto info = mallinfo2();
+            return static_cast<std::int64_t>(info.uordblks + info.hblkhd);
+        }
+        return -1;
+    }
+
+    // Returns free memory to the OS right away. Returns the call used, or null if unsupported.
+    const char* purge() const {
+        if (mallctl) {
+            forEachArena("arena.%u.purge", nullptr, 0);
+            return "mallctl arena.<i>.purge";
+        }
+        if (miCollect) {
+            miCollect(true);
+            return "mi_collect(true)";
+        }
+        if (mallocTrim) {
+            mallocTrim(0);
+            return "malloc_trim(0)";
+        }
+        return nullptr;
+    }
+
+    // Keeps free memory with the allocator by disabling decay and trimming. Returns the call used, or null if
+    // unsupported: mimalloc's purge delay can only be set from its environment variables before it starts.
+    const char* retain() const {
+        if (mallctl) {
+            long never = -1;
+            for (const char* option : {"arenas.dirty_decay_ms", "arenas.muzzy_decay_ms"}) {
+                mallctl(option, nullptr, nullptr, &never, sizeof(never));
+            }
+            forEachArena("arena.%u.dirty_decay_ms", &never, sizeof(never));
+            forEachArena("arena.%u.muzzy_decay_ms", &never, sizeof(never));
+            return "mallctl arena.<i>.dirty_decay_ms=-1";
+        }
+        if (mallopt) {
+            constexpr int trimThreshold = -1; // M_TRIM_THRESHOLD; -1 disables trimming.
+            mallopt(trimThreshold, -1);
+            return "mallopt(M_TRIM_THRESHOLD, -1)";
+        }
+        return nullptr;
+    }
+
+    // Purges what the allocator's decay timers have expired, after a wait. Returns the call used, or null if the
+    // allocator has no such call, in which case the wait alone lets its timers run.
+    const char* decay() const {
+        if (mallctl) {
+            forEachArena("arena.%u.decay", nullptr, 0);
+            return "mallctl arena.<i>.decay";
+        }
+        if (miCollect) {
+            miCollect(false);
+            return "mi_collect(false)";
+        }
+        return nullptr;
+    }
+
+  private:
+    // glibc's struct mallinfo2, which older headers do not declare.
+    struct MallInfo2 {
+        std::size_t arena, ordblks, smblks, hblks, hblkhd, usmblks, fsmblks, uordblks, fordblks, keepcost;
+    };
+    using Mallctl = int (*)(const char*, void*, std::size_t*, void*, std::size_t);
+    using Mallinfo2 = MallInfo2 (*)();
+    using MallocTrim = int (*)(std::size_t);
+    using Mallopt = int (*)(int, int);
+    using MiCollect = void (*)(bool);
+    using MallocUsableSize = std::size_t (*)(void*);
+
+    // jemalloc only refreshes its statistics when the epoch is advanced.
+    void refreshStatistics() const {
+        std::uint64_t epoch = 1;
+        std::size_t size = sizeof(epoch);
+        mallctl("epoch", &epoch, &size, &epoch, size);
+    }
+
+    std::size_t statistic(const char* name) const {
+        std::size_t value = 0;
+        std::size_t size = sizeof(value);
+        mallctl(name, &value, &size, nullptr, 0);
+        return value;
+    }
+
+    void forEachArena(const char* format, void* value, std::size_t size) const {
+        unsigned nArenas = 0;
+        std::size_t nArenasSize = sizeof(nArenas);
+        mallctl("arenas.narenas", &nArenas, &nArenasSize, nullptr, 0);
+        for (unsigned i = 0; i < nArenas; ++i) {
+            char option[64];
+            std::snprintf(option, sizeof(option), format, i);
+            mallctl(option, nullptr, nullptr, value, size);
+        }
+    }
+
+    const char* name = nullptr;
+    Mallctl mallctl = nullptr;
+    Mallinfo2 mallinfo2 = nullptr;
+    MallocTrim mallocTrim = nullptr;
+    Mallopt mallopt = nullptr;
+    MiCollect miCollect = nullptr;
+    MallocUsableSize mallocUsableSize = nullptr;
+};
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+#include <vector>
+
+#if _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+// Bump allocator over private memory mappings. The litterer keeps its own bookkeeping here rather than going through
+// the malloc it is littering, so that the heap under test only ever contains litter. Nothing is freed individually;
+// every mapping is returned to the OS at once by release() or the destructor.
+class Arena {
+  public:
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    Arena(Arena&& other) noexcept
+        : current(std::exchange(other.current, nullptr)), cursor(std::exchange(other.cursor, 0)),
+          end(std::exchange(other.end, 0)), mappedBytes(std::exchange(other.mappedBytes, 0)),
+          usedBytes(std::exchange(other.usedBytes, 0)) {}
+
+    ~Arena() {
+        release();
+    }
+
+    void* allocate(std::size_t size, std::size_t alignment = alignof(std::max_align_t)) {
+        std::uintptr_t start = (cursor + alignment - 1) & ~(alignment - 1);
+        if (!current || start + size > end) {
+            grow(size + alignment);
+            start = (cursor + alignment - 1) & ~(alignment - 1);
+        }
+        cursor = start + size;
+        usedBytes += size;
+        return reinterpret_cast<void*>(start);
+    }
+
+    template <typename T>
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void release() {
+        while (current) {
+            Chunk* previous = current->previous;
+            unmap(current, current->size);
+            current = previous;
+        }
+        cursor = end = 0;
+        mappedBytes = 0;
+        usedBytes = 0;
+    }
+
+    std::size_t mapped() const {
+        return mappedBytes;
+    }
+
+    // Bytes handed out, which bounds how much of the mappings is resident.
+    std::size_t used() const {
+        return usedBytes;
+    }
+
+  private:
+    struct Chunk {
+        Chunk* previous;
+        std::size_t size;
+    };
+
+    static constexpr std::size_t minimumChunkSize = 64 << 20;
+
+    void grow(std::size_t size) {
+        const std::size_t chunkSize = std::max(minimumChunkSize, (size + sizeof(Chunk) + 4095) & ~std::size_t{4095});
+        auto* chunk = static_cast<Chunk*>(map(chunkSize));
+        chunk->previous = current;
+        chunk->size = chunkSize;
+        current = chunk;
+        cursor = reinterpret_cast<std::uintptr_t>(chunk + 1);
+        end = reinterpret_cast<std::uintptr_t>(chunk) + chunkSize;
+        mappedBytes += chunkSize;
+    }
+
+    static void* map(std::size_t size) {
+#if _WIN32
+        void* memory = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+        if (!memory) {
+            throw std::bad_alloc();
+        }
+#else
+        void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (memory == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+#endif
+        return memory;
+    }
+
+    static void unmap(void* memory, [[maybe_unused]] std::size_t size) {
+#if _WIN32
+        VirtualFree(memory, 0, MEM_RELEASE);
+#else
+        munmap(memory, size);
+#endif
+    }
+
+    Chunk* current = nullptr;
+    std::uintptr_t cursor = 0;
+    std::uintptr_t end = 0;
+    std::size_t mappedBytes = 0;
+    std::size_t usedBytes = 0;
+};
+
+// Lets standard containers live in an Arena. Deallocation is a no-op, so containers should reserve up front.
+template <typename T>
+struct ArenaAllocator {
+    using value_type = T;
+
+    ArenaAllocator(Arena& arena) : arena(&arena) {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(std::size_t n) {
+        return arena->allocate<T>(n);
+    }
+
+    void deallocate(T*, std::size_t) {}
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const {
+        return arena == other.arena;
+    }
+
+    Arena* arena;
+};
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
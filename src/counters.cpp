@@ -0,0 +1,197 @@
+#include "counters.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#if __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+const char* const counterNames[5] = {"cycles", "instructions", "LLC-load-misses", "dTLB-load-misses", "page-faults"};
+
+namespace {
+rusage startUsage;
+
+// The getrusage fields that readCounters reports, as recorded by a helper thread.
+struct HelperUsage {
+    std::atomic<long> minorFaults{0};
+    std::atomic<long> majorFaults{0};
+    std::atomic<long> voluntarySwitches{0};
+    std::atomic<long> involuntarySwitches{0};
+};
+
+HelperUsage helperUsage[static_cast<int>(Helper::Count)];
+
+struct Usage {
+    long minorFaults = 0;
+    long majorFaults = 0;
+    long voluntarySwitches = 0;
+    long involuntarySwitches = 0;
+};
+
+// The helpers' usage at startCounters.
+Usage helperStart;
+
+Usage helperTotal() {
+    Usage total;
+    for (const auto& usage : helperUsage) {
+        total.minorFaults += usage.minorFaults.load();
+        total.majorFaults += usage.majorFaults.load();
+        total.voluntarySwitches += usage.voluntarySwitches.load();
+        total.involuntarySwitches += usage.involuntarySwitches.load();
+    }
+    return total;
+}
+
+#if __linux__
+struct Counter {
+    std::uint32_t type;
+    std::uint64_t config;
+    int fd = -1;
+    // errno of the failed perf_event_open.
+    int error = 0;
+};
+
+constexpr std::uint64_t cacheMiss(std::uint64_t cache) {
+    return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+
+// In the order of counterNames.
+Counter counters[] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, cacheMiss(PERF_COUNT_HW_CACHE_LL)},
+    {PERF_TYPE_HW_CACHE, cacheMiss(PERF_COUNT_HW_CACHE_DTLB)},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+};
+bool countersEnabled = false;
+
+int openCounter(const Counter& counter, bool excludeKernel) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = counter.type;
+    attr.config = counter.config;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = excludeKernel;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+}
+
+void openCounters() {
+    for (auto& counter : counters) {
+        if (counter.fd >= 0) {
+            close(counter.fd);
+        }
+        // Kernel events too where permitted, as perf stat does: allocators spend time in page faults and madvise.
+        counter.fd = openCounter(counter, false);
+        if (counter.fd < 0 && (errno == EACCES || errno == EPERM)) {
+            counter.fd = openCounter(counter, true);
+        }
+        counter.error = counter.fd < 0 ? errno : 0;
+    }
+    for (const auto& counter : counters) {
+        if (counter.fd >= 0) {
+            ioctl(counter.fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+// Value scaled up for the time the counter was multiplexed out, or -1 if it could not be read.
+double readCounter(const Counter& counter) {
+    struct {
+        std::uint64_t value;
+        std::uint64_t enabled;
+        std::uint64_t running;
+    } reading;
+    if (counter.fd < 0 || read(counter.fd, &reading, sizeof(reading)) != sizeof(reading)) {
+        return -1;
+    }
+    return reading.running ? static_cast<double>(reading.value) * reading.enabled / reading.running : 0;
+}
+#endif
+} // namespace
+
+void recordHelperUsage(Helper helper) {
+#if __linux__
+    rusage usage;
+    if (getrusage(RUSAGE_THREAD, &usage) == 0) {
+        auto& recorded = helperUsage[static_cast<int>(helper)];
+        recorded.minorFaults.store(usage.ru_minflt);
+        recorded.majorFaults.store(usage.ru_majflt);
+        recorded.voluntarySwitches.store(usage.ru_nvcsw);
+        recorded.involuntarySwitches.store(usage.ru_nivcsw);
+    }
+#else
+    (void)helper;
+#endif
+}
+
+void startCounters() {
+#if __linux__
+    if (const char* env = std::getenv("LITTER_COUNTERS"); env && atoi(env)) {
+        countersEnabled = true;
+        openCounters();
+    }
+#endif
+    getrusage(RUSAGE_SELF, &startUsage);
+    helperStart = helperTotal();
+}
+
+CounterReadings readCounters() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    const Usage helpers = helperTotal();
+    CounterReadings readings = {};
+    readings.maxRssKb = usage.ru_maxrss;
+    readings.minorFaults
+        = usage.ru_minflt - startUsage.ru_minflt - (helpers.minorFaults - helperStart.minorFaults);
+    readings.majorFaults
+        = usage.ru_majflt - startUsage.ru_majflt - (helpers.majorFaults - helperStart.majorFaults);
+    readings.voluntarySwitches
+        = usage.ru_nvcsw - startUsage.ru_nvcsw - (helpers.voluntarySwitches - helperStart.voluntarySwitches);
+    readings.involuntarySwitches
+        = usage.ru_nivcsw - startUsage.ru_nivcsw - (helpers.involuntarySwitches - helperStart.involuntarySwitches);
+#if __linux__
+    readings.eventsEnabled = countersEnabled;
+    for (std::size_t i = 0; i < sizeof(counters) / sizeof(counters[0]); ++i) {
+        readings.events[i] = countersEnabled ? readCounter(counters[i]) : -1;
+    }
+#endif
+    return readings;
+}
+
+void reportCounters() {
+    const auto readings = readCounters();
+    fprintf(stderr, "Max RSS: %ld KB\n", readings.maxRssKb);
+    fprintf(stderr, "Page faults: %ld minor, %ld major\n", readings.minorFaults, readings.majorFaults);
+    fprintf(stderr, "Context switches: %ld voluntary, %ld involuntary\n", readings.voluntarySwitches,
+            readings.involuntarySwitches);
+    if (!readings.eventsEnabled) {
+        return;
+    }
+#if __linux__
+    for (std::size_t i = 0; i < sizeof(counters) / sizeof(counters[0]); ++i) {
+        if (readings.events[i] < 0) {
+            fprintf(stderr, "%s: unavailable (%s)\n", counterNames[i],
+                    counters[i].error ? std::strerror(counters[i].error) : "read failed");
+        } else {
+            fprintf(stderr, "%s: %.0f\n", counterNames[i], readings.events[i]);
+        }
+    }
+#endif
+    if (readings.events[0] > 0 && readings.events[1] >= 0) {
+        fprintf(stderr, "IPC: %.3f\n", readings.events[1] / readings.events[0]);
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+// Measures the program itself, from after littering to exit, in litterer-standalone. getrusage gives the maximum
+// resident set size, page faults and context switches. With LITTER_COUNTERS=1, perf_event_open also counts cycles,
+// instructions, last level cache and dTLB load misses, and page faults, inherited by every thread the program creates.
+// Reading an inherited counter adds up the threads still running and those that have exited, but threads created
+// before startCounters are not counted at all, which is why litterer-standalone starts its own helper threads first.
+// getrusage counts the whole process, so the helpers record their own usage, and readCounters leaves it out. Counters
+// the kernel does not permit (perf_event_paranoid, containers) or the CPU does not support are reported as
+// unavailable. Nothing here allocates.
+
+struct CounterReadings {
+    // The peak of the whole process, litter included; the others are counted since startCounters.
+    long maxRssKb;
+    long minorFaults;
+    long majorFaults;
+    long voluntarySwitches;
+    long involuntarySwitches;
+    // perf events, named by counterNames; -1 where unavailable. Only with LITTER_COUNTERS=1.
+    bool eventsEnabled;
+    double events[5];
+};
+
+extern const char* const counterNames[5];
+
+// Threads of litterer-standalone's own that run alongside the program.
+enum class Helper { MemorySampler, Profiler, Count };
+
+// Records the calling helper thread's resource usage so far; helpers call it after every iteration.
+void recordHelperUsage(Helper helper);
+
+// Starts measuring, or starts over, e.g. in a forked child.
+void startCounters();
+
+CounterReadings readCounters();
+
+// Prints the measurements to stderr.
+void reportCounters();
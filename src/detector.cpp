@@ -1,11 +1,28 @@
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <bit>
+#include <cmath>
 #include <cstddef>
+#include <cstdio>
+#include <cstdlib>
 #include <fstream>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 
 #include <mimalloc.h>
 
 #define PAGE_SIZE 4096zu
+// Realloc growth factors are binned in eighths, up to 8x.
+#define GROWTH_FACTOR_STEPS 8zu
+#define GROWTH_FACTOR_BINS 64zu
+#define CHAIN_LENGTH_BINS 64zu
+#define MAX_PHASES 64zu
+// Phase shifts and the allocation API mix are recorded on power-of-two size classes up to PAGE_SIZE.
+#define SIZE_CLASSES 13zu
+// Alignments are binned by their logarithm, from 1 to 32 KiB and above.
+#define ALIGNMENT_BINS 16zu
 
 namespace {
 static std::atomic_bool ready{false};
@@ -20,6 +37,197 @@ static std::atomic<double> average{0};
 static std::atomic_int64_t liveAllocations{0};
 static std::atomic_int64_t maxLiveAllocations{0};
 
+// A phase is a stretch of the run with its own size distribution and peak of live allocations. Phases start at
+// explicit markers (detector_mark_phase) or, with DETECTOR_PHASE_WINDOW, whenever the size distribution of a window
+// of allocations drifts from that of the current phase by more than DETECTOR_PHASE_THRESHOLD (total variation).
+struct Phase {
+    std::vector<std::atomic_uint64_t> bins = std::vector<std::atomic_uint64_t>(PAGE_SIZE);
+    std::array<std::atomic_uint64_t, SIZE_CLASSES> sizeClasses{};
+    std::atomic_uint64_t nAllocations{0};
+    std::atomic<double> average{0};
+    std::atomic_int64_t maxLiveAllocations{0};
+    // Index of the run's first allocation in this phase.
+    std::uint64_t start = 0;
+    char name[64] = {};
+};
+
+static std::vector<Phase> phases(MAX_PHASES);
+static std::atomic_size_t currentPhase{0};
+static std::mutex phaseLock;
+
+static std::uint64_t phaseWindow = 0;
+static double phaseThreshold = 0.25;
+static std::array<std::atomic_uint64_t, SIZE_CLASSES> windowSizeClasses{};
+static std::atomic_uint64_t windowAllocations{0};
+
+std::size_t sizeClass(std::size_t size) {
+    return std::min<std::size_t>(std::bit_width(size - 1), SIZE_CLASSES - 1);
+}
+
+// Starts a new phase, named `name` or numbered. Returns false once MAX_PHASES are in use.
+bool startPhase(const char* name) {
+    std::lock_guard<std::mutex> guard(phaseLock);
+    const std::size_t next = currentPhase + 1;
+    if (next == MAX_PHASES) {
+        return false;
+    }
+
+    Phase& phase = phases[next];
+    phase.start = nAllocations;
+    phase.maxLiveAllocations = liveAllocations.load();
+    if (name) {
+        std::snprintf(phase.name, sizeof(phase.name), "%s", name);
+    } else {
+        std::snprintf(phase.name, sizeof(phase.name), "phase-%zu", next);
+    }
+    currentPhase = next;
+    return true;
+}
+
+// Called by the thread completing a window: compares the window's size classes with the current phase's.
+void endWindow() {
+    const Phase& phase = phases[currentPhase];
+    const double phaseTotal = phase.nAllocations;
+    double windowTotal = 0;
+    for (const auto& count : windowSizeClasses) {
+        windowTotal += count;
+    }
+
+    double distance = 0;
+    if (phaseTotal > 0 && windowTotal > 0) {
+        for (std::size_t i = 0; i < SIZE_CLASSES; ++i) {
+            distance += std::abs(phase.sizeClasses[i] / phaseTotal - windowSizeClasses[i] / windowTotal);
+        }
+        distance /= 2;
+    }
+    for (auto& count : windowSizeClasses) {
+        count = 0;
+    }
+
+    // The window that triggers a shift still counts towards the phase it leaves.
+    if (distance > phaseThreshold) {
+        startPhase(nullptr);
+    }
+}
+
+void processPhaseAllocation(std::size_t size, std::int64_t liveAllocationsSnapshot) {
+    Phase& phase = phases[currentPhase];
+    phase.average = phase.average + (size - phase.average) / (phase.nAllocations + 1);
+    phase.nAllocations++;
+    phase.bins[std::min(size, PAGE_SIZE) - 1]++;
+    phase.sizeClasses[sizeClass(size)]++;
+
+    std::int64_t maxLiveAllocationsSnapshot = phase.maxLiveAllocations;
+    while (liveAllocationsSnapshot > maxLiveAllocationsSnapshot) {
+        phase.maxLiveAllocations.compare_exchange_weak(maxLiveAllocationsSnapshot, liveAllocationsSnapshot);
+        maxLiveAllocationsSnapshot = phase.maxLiveAllocations;
+    }
+
+    if (phaseWindow) {
+        windowSizeClasses[sizeClass(size)]++;
+        if (windowAllocations.fetch_add(1) + 1 == phaseWindow) {
+            endWindow();
+            windowAllocations = 0;
+        }
+    }
+}
+
+// Allocation entry points, as named in the profile's AllocationApis.
+enum Api { Malloc, Calloc, PosixMemalign, AlignedAlloc, NApis };
+static const char* apiNames[NApis] = {"malloc", "calloc", "posix_memalign", "aligned_alloc"};
+
+// Row-major tables by size class: calls per API, and requested alignments of posix_memalign and aligned_alloc.
+static std::vector<std::atomic_uint64_t> apiMix(SIZE_CLASSES * NApis);
+static std::vector<std::atomic_uint64_t> alignments(SIZE_CLASSES * ALIGNMENT_BINS);
+
+void processApi(Api api, std::size_t size, std::size_t alignment = 0) {
+    const std::size_t row = sizeClass(size);
+    apiMix[row * NApis + api]++;
+    if (alignment) {
+        alignments[row * ALIGNMENT_BINS + std::min<std::size_t>(std::countr_zero(alignment), ALIGNMENT_BINS - 1)]++;
+    }
+}
+
+// A realloc chain is the sequence of reallocs applied to one object, from its first realloc until it is freed.
+struct ReallocChain {
+    std::size_t startSize;
+    std::size_t size;
+    std::size_t length;
+};
+
+static std::mutex reallocChainsLock;
+static std::unordered_map<void*, ReallocChain> reallocChains;
+static std::atomic_bool reallocChainsEmpty{true};
+
+static std::atomic_uint64_t nReallocs{0};
+static std::atomic_uint64_t nReallocsMoved{0};
+static std::vector<std::atomic_uint64_t> reallocStartSizes(PAGE_SIZE);
+static std::vector<std::atomic_uint64_t> reallocGrowthFactors(GROWTH_FACTOR_BINS);
+static std::vector<std::atomic_uint64_t> reallocChainLengths(CHAIN_LENGTH_BINS);
+
+void endReallocChain(const ReallocChain& chain) {
+    reallocStartSizes[std::clamp(chain.startSize, 1zu, PAGE_SIZE) - 1]++;
+    reallocChainLengths[std::min(chain.length, CHAIN_LENGTH_BINS) - 1]++;
+}
+
+// Records one step of the chain of `oldPointer`, reallocated to `size` bytes at `pointer`. The size of the allocation
+// that starts a chain is not tracked, so its usable size, `oldUsableSize`, stands in for it.
+void processRealloc(void* oldPointer, std::size_t oldUsableSize, void* pointer, std::size_t size) {
+    nReallocs++;
+    if (pointer != oldPointer) {
+        nReallocsMoved++;
+    }
+
+    std::lock_guard<std::mutex> guard(reallocChainsLock);
+    ReallocChain chain{oldUsableSize, oldUsableSize, 0};
+    if (const auto it = reallocChains.find(oldPointer); it != reallocChains.end()) {
+        chain = it->second;
+        reallocChains.erase(it);
+    }
+
+    const double factor = static_cast<double>(size) / static_cast<double>(std::max(chain.size, 1zu));
+    const auto factorIndex = static_cast<std::size_t>(std::lround(factor * GROWTH_FACTOR_STEPS));
+    reallocGrowthFactors[std::min(factorIndex, GROWTH_FACTOR_BINS - 1)]++;
+
+    chain.size = size;
+    ++chain.length;
+    reallocChains[pointer] = chain;
+    reallocChainsEmpty = false;
+}
+
+void processFree(void* pointer) {
+    if (reallocChainsEmpty) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(reallocChainsLock);
+    if (const auto it = reallocChains.find(pointer); it != reallocChains.end()) {
+        endReallocChain(it->second);
+        reallocChains.erase(it);
+        reallocChainsEmpty = reallocChains.empty();
+    }
+}
+
+template <typename T>
+void writeArray(std::ofstream& outputFile, const std::vector<T>& values) {
+    outputFile << "[ " << values[0];
+    for (std::size_t i = 1; i < values.size(); ++i) {
+        outputFile << ", " << values[i];
+    }
+    outputFile << "]";
+}
+
+template <typename T>
+void writeRows(std::ofstream& outputFile, const std::vector<T>& values, std::size_t columns) {
+    for (std::size_t row = 0; row < values.size() / columns; ++row) {
+        outputFile << (row ? ", [ " : "[ ") << values[row * columns];
+        for (std::size_t i = 1; i < columns; ++i) {
+            outputFile << ", " << values[row * columns + i];
+        }
+        outputFile << "]";
+    }
+}
+
 template <bool addToTotal>
 void processAllocation(std::size_t size) {
     // This only does not mess with the statistics because we ignore malloc(0)
@@ -44,30 +252,93 @@ void processAllocation(std::size_t size) {
             maxLiveAllocations.compare_exchange_weak(maxLiveAllocationsSnapshot, liveAllocationsSnapshot);
             maxLiveAllocationsSnapshot = maxLiveAllocations;
         }
+        processPhaseAllocation(size, liveAllocationsSnapshot);
+    } else {
+        processPhaseAllocation(size, liveAllocations);
     }
 }
 
 class Initialization {
   public:
     Initialization() {
+        std::snprintf(phases[0].name, sizeof(phases[0].name), "phase-0");
+        if (const char* env = std::getenv("DETECTOR_PHASE_WINDOW")) {
+            phaseWindow = std::strtoull(env, nullptr, 10);
+        }
+        if (const char* env = std::getenv("DETECTOR_PHASE_THRESHOLD")) {
+            phaseThreshold = std::atof(env);
+        }
         ready = true;
     }
 
     ~Initialization() {
         ready = false;
 
+        // Chains still live at exit end here.
+        {
+            std::lock_guard<std::mutex> guard(reallocChainsLock);
+            for (const auto& [pointer, chain] : reallocChains) {
+                endReallocChain(chain);
+            }
+            reallocChains.clear();
+            reallocChainsEmpty = true;
+        }
+
         std::ofstream outputFile("detector.out");
 
         outputFile << "{" << std::endl;
 
-        outputFile << "\t\"Bins\": [ " << bins[0];
-        for (std::size_t i = 1; i < bins.size(); ++i) {
-            outputFile << ", " << bins[i];
+        outputFile << "\t\"Bins\": ";
+        writeArray(outputFile, bins);
+        outputFile << "," << std::endl;
+
+        outputFile << "\t\"NAllocations\": " << nAllocations << ", \"Average\": " << average
+                   << ", \"MaxLiveAllocations\": " << maxLiveAllocations << "," << std::endl;
+
+        // Realloc chains: GrowthFactors is binned in steps of 1/GrowthFactorSteps, StartSizes and ChainLengths by 1.
+        outputFile << "\t\"NReallocs\": " << nReallocs << ", \"NReallocsMoved\": " << nReallocsMoved
+                   << ", \"GrowthFactorSteps\": " << GROWTH_FACTOR_STEPS << "," << std::endl;
+        outputFile << "\t\"ReallocStartSizes\": ";
+        writeArray(outputFile, reallocStartSizes);
+        outputFile << "," << std::endl;
+        outputFile << "\t\"ReallocGrowthFactors\": ";
+        writeArray(outputFile, reallocGrowthFactors);
+        outputFile << "," << std::endl;
+        outputFile << "\t\"ReallocChainLengths\": ";
+        writeArray(outputFile, reallocChainLengths);
+        outputFile << "," << std::endl;
+
+        // One row per power-of-two size class, as in phase detection.
+        outputFile << "\t\"AllocationApis\": [ \"" << apiNames[0] << "\"";
+        for (std::size_t i = 1; i < NApis; ++i) {
+            outputFile << ", \"" << apiNames[i] << "\"";
         }
         outputFile << "]," << std::endl;
+        outputFile << "\t\"ApiMix\": [";
+        writeRows(outputFile, apiMix, NApis);
+        outputFile << "]," << std::endl;
+        outputFile << "\t\"Alignments\": [";
+        writeRows(outputFile, alignments, ALIGNMENT_BINS);
+        outputFile << "]," << std::endl;
 
-        outputFile << "\t\"NAllocations\": " << nAllocations << ", \"Average\": " << average
-                   << ", \"MaxLiveAllocations\": " << maxLiveAllocations << std::endl;
+        // Each phase has the same fields as the whole run, which the litterer can use instead (LITTER_PHASE).
+        outputFile << "\t\"Phases\": [" << std::endl;
+        for (std::size_t i = 0; i <= currentPhase; ++i) {
+            const Phase& phase = phases[i];
+            outputFile << "\t\t{ \"Name\": \"";
+            for (const char* c = phase.name; *c; ++c) {
+                if (*c == '"' || *c == '\\') {
+                    outputFile << '\\';
+                }
+                outputFile << *c;
+            }
+            outputFile << "\", \"Start\": " << phase.start << ", \"NAllocations\": " << phase.nAllocations
+                       << ", \"Average\": " << phase.average
+                       << ", \"MaxLiveAllocations\": " << phase.maxLiveAllocations << ", \"Bins\": ";
+            writeArray(outputFile, phase.bins);
+            outputFile << " }" << (i < currentPhase ? "," : "") << std::endl;
+        }
+        outputFile << "\t]" << std::endl;
         outputFile << "}" << std::endl;
     }
 };
@@ -75,6 +346,14 @@ class Initialization {
 static Initialization _;
 } // namespace
 
+// Starts a new phase of the profile at this point of the run. Programs can call this through dlsym, or with a weak
+// declaration, so that they run unchanged without the detector.
+extern "C" void detector_mark_phase(const char* name) {
+    ++busy;
+    startPhase(name);
+    --busy;
+}
+
 extern "C" void* malloc(std::size_t size) {
     if (size == 0) {
         return nullptr;
@@ -85,6 +364,7 @@ extern "C" void* malloc(std::size_t size) {
     if (!busy && ready) {
         ++busy;
         processAllocation<true>(size);
+        processApi(Malloc, size);
         --busy;
     }
 
@@ -99,6 +379,7 @@ extern "C" void free(void* pointer) {
     if (!busy && ready) {
         ++busy;
         liveAllocations--;
+        processFree(pointer);
         --busy;
     }
 
@@ -115,6 +396,7 @@ extern "C" void* calloc(std::size_t nmemb, std::size_t size) {
     if (!busy && ready) {
         ++busy;
         processAllocation<true>(nmemb * size);
+        processApi(Calloc, nmemb * size);
         --busy;
     }
 
@@ -122,15 +404,25 @@ extern "C" void* calloc(std::size_t nmemb, std::size_t size) {
 }
 
 extern "C" void* realloc(void* ptr, std::size_t size) {
+    const std::size_t oldUsableSize = ptr ? mi_usable_size(ptr) : 0;
     void* pointer = mi_realloc(ptr, size);
 
     if (size == 0) {
+        // Frees `ptr`, which ends its chain.
+        if (ptr && !busy && ready) {
+            ++busy;
+            processFree(ptr);
+            --busy;
+        }
         return nullptr;
     }
 
     if (!busy && ready) {
         ++busy;
         processAllocation<false>(size);
+        if (ptr && pointer) {
+            processRealloc(ptr, oldUsableSize, pointer, size);
+        }
         --busy;
     }
 
@@ -138,15 +430,25 @@ extern "C" void* realloc(void* ptr, std::size_t size) {
 }
 
 extern "C" void* reallocarray(void* ptr, std::size_t nmemb, std::size_t size) {
+    const std::size_t oldUsableSize = ptr ? mi_usable_size(ptr) : 0;
     void* pointer = mi_reallocarray(ptr, nmemb, size);
 
     if (nmemb == 0 || size == 0) {
+        // Frees `ptr`, which ends its chain.
+        if (ptr && !busy && ready) {
+            ++busy;
+            processFree(ptr);
+            --busy;
+        }
         return nullptr;
     }
 
     if (!busy && ready) {
         ++busy;
         processAllocation<false>(nmemb * size);
+        if (ptr && pointer) {
+            processRealloc(ptr, oldUsableSize, pointer, nmemb * size);
+        }
         --busy;
     }
 
@@ -164,6 +466,7 @@ extern "C" int posix_memalign(void** memptr, std::size_t alignment, std::size_t
     if (!busy && ready) {
         ++busy;
         processAllocation<true>(size);
+        processApi(PosixMemalign, size, alignment);
         --busy;
     }
 
@@ -180,6 +483,7 @@ extern "C" void* aligned_alloc(std::size_t alignment, std::size_t size) {
     if (!busy && ready) {
         ++busy;
         processAllocation<true>(size);
+        processApi(AlignedAlloc, size, alignment);
         --busy;
     }
 
@@ -0,0 +1,244 @@
+#include "fork-server.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Everything here lives in static storage: the server must not touch the littered heap, so that every child starts
+// from exactly the same heap state.
+namespace {
+constexpr std::size_t maxRequestSize = 1 << 20;
+constexpr std::size_t maxArguments = 4096;
+constexpr std::size_t maxEnvironment = 4096;
+
+char buffer[maxRequestSize];
+std::size_t bufferFilled = 0;
+
+char* arguments[maxArguments + 1];
+char* environment[maxEnvironment + 1];
+
+volatile std::sig_atomic_t stopping = 0;
+
+void onStopSignal(int) {
+    stopping = 1;
+}
+
+[[noreturn]] void exitWithError(const char* message) {
+    fprintf(stderr, "[ERROR] Fork server: %s (%s)\n", message, std::strerror(errno));
+    exit(EXIT_FAILURE);
+}
+
+// Returns the size of the first complete request in the buffer, or 0 if it is still incomplete.
+std::size_t completeRequestSize() {
+    std::size_t separators = 0;
+    std::size_t stringStart = 0;
+    for (std::size_t i = 0; i < bufferFilled; ++i) {
+        if (buffer[i] != '\0') {
+            continue;
+        }
+        if (i == stringStart && ++separators == 2) {
+            return i + 1;
+        }
+        stringStart = i + 1;
+    }
+    return 0;
+}
+
+// Reads the next request from `fd` into the buffer. Returns its size, or 0 on end of input.
+std::size_t readRequest(int fd) {
+    for (;;) {
+        if (const auto size = completeRequestSize()) {
+            return size;
+        }
+        if (bufferFilled == maxRequestSize) {
+            errno = E2BIG;
+            exitWithError("request too large");
+        }
+
+        const auto n = read(fd, buffer + bufferFilled, maxRequestSize - bufferFilled);
+        if (n < 0 && errno == EINTR && !stopping) {
+            continue;
+        }
+        if (n <= 0) {
+            return 0;
+        }
+        bufferFilled += n;
+    }
+}
+
+void consumeRequest(std::size_t size) {
+    std::memmove(buffer, buffer + size, bufferFilled - size);
+    bufferFilled -= size;
+}
+
+// Called in the child: splits the first request of the buffer into the static argument and environment arrays.
+ForkServerRequest decodeRequest(int argc, char** argv, char** envp) {
+    std::size_t nArguments = 0;
+    arguments[nArguments++] = argv[0];
+
+    char* string = buffer;
+    for (; *string; string += std::strlen(string) + 1) {
+        if (nArguments == maxArguments) {
+            errno = E2BIG;
+            exitWithError("too many arguments");
+        }
+        arguments[nArguments++] = string;
+    }
+    ++string;
+
+    if (nArguments == 1) {
+        // No arguments in the request: reuse the ones the server was started with.
+        for (int i = 1; i < argc && nArguments < maxArguments; ++i) {
+            arguments[nArguments++] = argv[i];
+        }
+    }
+    arguments[nArguments] = nullptr;
+
+    // Overrides come first so that lookups find them before the inherited entries with the same key.
+    std::size_t nEnvironment = 0;
+    for (; *string && nEnvironment < maxEnvironment; string += std::strlen(string) + 1) {
+        environment[nEnvironment++] = string;
+    }
+    const std::size_t nOverrides = nEnvironment;
+
+    for (char** inherited = envp; *inherited && nEnvironment < maxEnvironment; ++inherited) {
+        const char* equals = std::strchr(*inherited, '=');
+        const std::size_t keySize = equals ? equals - *inherited + 1 : std::strlen(*inherited);
+
+        bool overridden = false;
+        for (std::size_t i = 0; i < nOverrides && !overridden; ++i) {
+            overridden = std::strncmp(environment[i], *inherited, keySize) == 0;
+        }
+        if (!overridden) {
+            environment[nEnvironment++] = *inherited;
+        }
+    }
+    environment[nEnvironment] = nullptr;
+    environ = environment;
+
+    return {static_cast<int>(nArguments), arguments, environment};
+}
+
+int decodeStatus(int status) {
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    }
+    return WIFSIGNALED(status) ? 128 + WTERMSIG(status) : -1;
+}
+
+void reply(int fd, pid_t pid, int status) {
+    char line[64];
+    const int size = snprintf(line, sizeof(line), "%d %d\n", pid, status);
+    if (write(fd, line, size) != size) {
+        fprintf(stderr, "[WARNING] Fork server: could not reply for PID %d.\n", pid);
+    }
+}
+
+// Serves every request on `input`. Returns true in forked children, with their request at the front of the buffer.
+bool serveConnection(int input, int output, std::size_t& nRuns) {
+    while (const auto size = readRequest(input)) {
+        fflush(nullptr);
+        const pid_t pid = fork();
+        if (pid < 0) {
+            exitWithError("could not fork");
+        }
+        if (pid == 0) {
+            return true;
+        }
+
+        int status = 0;
+        while (waitpid(pid, &status, 0) < 0) {
+            if (errno != EINTR) {
+                exitWithError("could not wait for child");
+            }
+        }
+
+        ++nRuns;
+        reply(output, pid, decodeStatus(status));
+        consumeRequest(size);
+    }
+    return false;
+}
+
+void installStopHandlers() {
+    struct sigaction action = {};
+    action.sa_handler = onStopSignal;
+    sigemptyset(&action.sa_mask);
+    // No SA_RESTART: blocking accept/read calls must return so the server can shut down.
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+}
+
+void restoreStopHandlers() {
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+}
+} // namespace
+
+ForkServerRequest serveForks(const char* address, int argc, char** argv, char** envp) {
+    installStopHandlers();
+    std::size_t nRuns = 0;
+
+    if (std::strcmp(address, "-") == 0) {
+        fprintf(stderr, "Fork server reading requests from stdin (PID: %d)...\n", getpid());
+        if (serveConnection(STDIN_FILENO, STDERR_FILENO, nRuns)) {
+            // The child must not consume the requests meant for the server.
+            const int devNull = open("/dev/null", O_RDONLY);
+            dup2(devNull, STDIN_FILENO);
+            close(devNull);
+            restoreStopHandlers();
+            return decodeRequest(argc, argv, envp);
+        }
+    } else {
+        sockaddr_un socketAddress = {};
+        socketAddress.sun_family = AF_UNIX;
+        if (std::strlen(address) >= sizeof(socketAddress.sun_path)) {
+            errno = ENAMETOOLONG;
+            exitWithError("socket path too long");
+        }
+        std::strcpy(socketAddress.sun_path, address);
+
+        const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener < 0) {
+            exitWithError("could not create socket");
+        }
+        unlink(address);
+        if (bind(listener, reinterpret_cast<sockaddr*>(&socketAddress), sizeof(socketAddress)) < 0
+            || listen(listener, 1) < 0) {
+            exitWithError("could not listen on socket");
+        }
+
+        fprintf(stderr, "Fork server listening on %s (PID: %d)...\n", address, getpid());
+        while (!stopping) {
+            const int connection = accept(listener, nullptr, nullptr);
+            if (connection < 0) {
+                continue;
+            }
+
+            bufferFilled = 0;
+            if (serveConnection(connection, connection, nRuns)) {
+                close(connection);
+                close(listener);
+                restoreStopHandlers();
+                return decodeRequest(argc, argv, envp);
+            }
+            close(connection);
+        }
+
+        close(listener);
+        unlink(address);
+    }
+
+    fprintf(stderr, "Fork server exiting after %zu run(s).\n", nRuns);
+    fflush(stderr);
+    _exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+struct ForkServerRequest {
+    int argc;
+    char** argv;
+    char** envp;
+};
+
+// Serves run requests on `address`, which is either the path of a Unix socket to listen on, or "-" to read requests
+// from stdin. Each request forks a copy-on-write child of the (already littered) process. The parent never returns;
+// each child returns the arguments and environment its run of the program's main should use.
+//
+// A request is a sequence of NUL-terminated strings: the arguments replacing argv[1..], an empty string, the
+// KEY=VALUE environment entries to set on top of the server's environment, and a final empty string. Once the child
+// exits, the server replies with a "<pid> <status>\n" line, where the status follows shell conventions.
+ForkServerRequest serveForks(const char* address, int argc, char** argv, char** envp);
@@ -1,7 +1,230 @@
 #pragma once
 
 #ifdef __cplusplus
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+namespace litterer {
+enum class FreeStrategy {
+    // Free a random subset of the litter.
+    Random,
+    // Free the litter at the highest addresses.
+    HighestAddresses,
+    // Keep one random object alive in every page (of LitterConfig::pageSize) touched by the litter, and free a random
+    // subset of the others.
+    PinPages,
+};
+
+enum class TouchMode {
+    None,
+    // Write the first byte of each object.
+    First,
+    // Write one byte per cache line.
+    CacheLine,
+    // Write the whole object.
+    Full,
+};
+
+enum class TargetMetric {
+    None,
+    // Resident set size of the process in MB, leaving out the litterer's bookkeeping.
+    ResidentMegabytes,
+    // Fraction of the pages holding litter where live litter sits next to a hole freed by the litterer.
+    PartialPages,
+    // Heap memory the allocator holds over the memory allocated from it, as reported by the allocator.
+    FragmentationRatio,
+    // MB between the lowest and the highest live litter object.
+    HeapSpanMegabytes,
+};
+
+// What to do with the allocator's free memory once littering is done, so that the heap's state when the program starts
+// does not depend on the allocator's timers.
+enum class PurgeMode {
+    // Leave it to the allocator.
+    None,
+    // Return free memory to the OS right away (malloc_trim, mallctl arena.<i>.purge or mi_collect).
+    Purge,
+    // Disable decay and trimming, so that free memory stays with the allocator.
+    Retain,
+    // Wait LitterConfig::decaySeconds, then purge what the allocator's decay timers have expired.
+    Decay,
+};
+
+// Litter until a measured fragmentation level is reached, rather than a fixed amount, so that allocators can be
+// compared at the same level.
+struct LitterTarget {
+    TargetMetric metric = TargetMetric::None;
+    double value = 0;
+};
+
+// Ages the litter after littering: each generation frees `churn` of the live litter, following the free strategy, and
+// allocates as many objects from the profile, until `metric` changes by less than `tolerance` (relative) from one
+// generation to the next. This approximates the steady state of a long-running program.
+struct LitterGenerations {
+    // Disabled if 0.
+    unsigned maxGenerations = 0;
+    double churn = 0.1;
+    TargetMetric metric = TargetMetric::HeapSpanMegabytes;
+    double tolerance = 0.01;
+};
+
+// Short names of the modes, as accepted by the LITTER_* environment variables that take them and written to results.
+const char* freeStrategyName(FreeStrategy strategy);
+const char* touchModeName(TouchMode mode);
+const char* targetMetricName(TargetMetric metric);
+const char* purgeModeName(PurgeMode mode);
+
+struct LitterConfig {
+    // Detector profile to draw object sizes and the number of live objects from. A comma-separated list of profiles,
+    // each optionally followed by :<weight> (default 1), litters from their mixture: each contributes weight times its
+    // MaxLiveAllocations to the live objects, with sizes drawn from its histogram.
+    const char* profile = "detector.out";
+    // Phase of the profile to litter from: its name, its index, or "last". The whole run if null.
+    const char* phase = nullptr;
+    // Log destination; stderr if null.
+    const char* logFilename = nullptr;
+    // Random if unset.
+    std::optional<std::uint32_t> seed;
+    // Fraction of the litter to keep on the heap.
+    double occupancy = 0.95;
+    // The litter is `multiplier` times the profile's maximum number of live allocations. With a target, this is the
+    // most litter that will be allocated.
+    std::uint32_t multiplier = 20;
+    FreeStrategy freeStrategy = FreeStrategy::Random;
+    TouchMode touch = TouchMode::None;
+    // Page granularity of FreeStrategy::PinPages; the system page size if 0.
+    std::size_t pageSize = 0;
+    // Make the pages of the surviving litter resident after littering.
+    bool prefault = false;
+    // All hardware threads if 0.
+    unsigned prefaultThreads = 0;
+    // Allocate from this many producer threads, which hand the objects to be freed to consumer threads.
+    unsigned producers = 0;
+    unsigned consumers = 0;
+    // Fraction of the freed objects handed to a consumer; producers free the rest themselves.
+    double remoteFraction = 1;
+    // Produce part of the litter by replaying the profile's realloc growth chains, and compare how often realloc moves
+    // objects on the littered heap with a clean one.
+    bool reallocChains = false;
+    // Allocate through the profile's mix of malloc, calloc, posix_memalign and aligned_alloc, and of alignments, per
+    // size class, rather than through malloc alone.
+    bool apiMix = false;
+    // Keep the usable sizes of the freed litter for freedObjects, where the allocator reports them.
+    bool keepFreedSizes = false;
+    // Litter in rounds of the profile's maximum number of live allocations, each keeping `occupancy` of its objects,
+    // until the target is reached. Only with FreeStrategy::Random and without producers.
+    LitterTarget target;
+    LitterGenerations generations;
+    PurgeMode purge = PurgeMode::None;
+    std::uint32_t decaySeconds = 10;
+    // Pause after littering, e.g. to attach a profiler.
+    std::uint32_t sleepSeconds = 0;
+    // Log the CPU, its frequency governor, address space randomization and the transparent huge page settings, which
+    // timings depend on. Set from the environment along with LITTER_STABILIZE, LITTER_CPUS or LITTER_MLOCK.
+    bool logSystem = false;
+
+    // Reads the LITTER_* environment variables, exiting on invalid values.
+    static LitterConfig fromEnvironment();
+};
+
+struct LitterStep {
+    // A string literal such as "allocation".
+    const char* name = nullptr;
+    std::uint64_t nanoseconds = 0;
+};
+
+struct LitterStatistics {
+    std::uint32_t seed = 0;
+    std::size_t allocated = 0;
+    std::size_t freed = 0;
+    // Objects still held by the Litter, which release() frees.
+    std::size_t retained = 0;
+    std::size_t remoteFrees = 0;
+    std::size_t pinnedPages = 0;
+    std::size_t reallocs = 0;
+    std::size_t reallocsMoved = 0;
+    // Fraction of reallocs that moved their object when replaying chains before and after littering.
+    double cleanReallocMoveRate = 0;
+    double litteredReallocMoveRate = 0;
+    // Litter allocated with posix_memalign or aligned_alloc, and the padding estimated around the live part of it.
+    std::size_t alignedAllocations = 0;
+    std::size_t alignmentWasteBytes = 0;
+    // Rounds of littering towards LitterConfig::target, and the last measurement.
+    std::size_t rounds = 0;
+    double targetMeasured = 0;
+    bool targetReached = false;
+    // Generations of churn run, and the last measurement of LitterGenerations::metric.
+    std::size_t generations = 0;
+    double generationMeasured = 0;
+    bool converged = false;
+    std::int64_t pageFaults = 0;
+    double milliseconds = 0;
+    // Wall-clock time of each step of littering, in the order they first ran.
+    static constexpr std::size_t maxSteps = 8;
+    LitterStep steps[maxSteps];
+    std::size_t nSteps = 0;
+    // Object providing the malloc that was littered, and the allocator recognized in it (null if unknown).
+    const char* mallocObject = nullptr;
+    const char* allocator = nullptr;
+    // Drop in resident memory across the post-litter purge.
+    std::int64_t purgedBytes = 0;
+    // Memory mapped for the litterer's own bookkeeping, outside of the heap.
+    std::size_t bookkeepingBytes = 0;
+};
+
+// Litters the heap from a detector profile, keeping track of the surviving objects so they can be released again.
+// This lets a harness litter, measure, release and repeat with other parameters within a single process. The Litter's
+// bookkeeping lives in private memory mappings, never in the heap it litters. It holds every litter object until
+// release() or leak(), as a 4-byte handle (8 bytes should the heap span more than 32 GiB), plus as much scratch space
+// again to sort them by address: frees are streamed in chunks, but the table of objects itself is not. Invalid
+// configurations and profiles are fatal, as with the environment variables.
+class Litter {
+  public:
+    explicit Litter(const LitterConfig& config);
+    ~Litter();
+
+    Litter(const Litter&) = delete;
+    Litter& operator=(const Litter&) = delete;
+
+    // Releases any litter from a previous run, then litters the heap.
+    void run();
+
+    // Frees every retained litter object and unmaps the bookkeeping.
+    void release();
+
+    // Leaves the retained litter on the heap for good, and unmaps the bookkeeping.
+    void leak();
+
+    const LitterConfig& config() const {
+        return configuration;
+    }
+
+    const LitterStatistics& statistics() const {
+        return stats;
+    }
+
+    // Copies the addresses of up to `capacity` litter objects freed by the last run() into `addresses`, e.g. to tell
+    // whether the program's allocations reuse their holes, and returns how many there are. Unless null, `sizes` gets
+    // their usable sizes with LitterConfig::keepFreedSizes, and zeros where they are unknown (e.g. with a target).
+    // Objects freed by producer threads or by later generations are not kept track of. Only valid until release() or
+    // leak().
+    std::size_t freedObjects(void** addresses, std::size_t* sizes, std::size_t capacity) const;
+
+  private:
+    struct State;
+
+    LitterConfig configuration;
+    LitterStatistics stats;
+    State* state = nullptr;
+};
+} // namespace litterer
+
 extern "C" void runLitterer();
+// Exported by liblitterer.so: litters the heap now, on the calling thread, e.g. once a service has warmed up. Find it
+// with dlsym, or declare it weak, so that the program also runs without the litterer.
+extern "C" void litterNow();
 #else
 void runLitterer();
+void litterNow();
 #endif
@@ -0,0 +1,300 @@
+#include "json-reader.h"
+
+#include <charconv>
+#include <cstring>
+
+#if _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+const JsonValue nullValue;
+
+class Parser {
+  public:
+    Parser(std::string_view text, Arena& arena) : position(text.data()), end(text.data() + text.size()), arena(arena) {}
+
+    bool parseDocument(JsonValue& value) {
+        if (!parseValue(value, 0)) {
+            return false;
+        }
+        skipWhitespace();
+        return position == end;
+    }
+
+  private:
+    static constexpr int maxDepth = 64;
+
+    void skipWhitespace() {
+        while (position < end && (*position == ' ' || *position == '\t' || *position == '\n' || *position == '\r')) {
+            ++position;
+        }
+    }
+
+    bool consume(char c) {
+        skipWhitespace();
+        if (position < end && *position == c) {
+            ++position;
+            return true;
+        }
+        return false;
+    }
+
+    bool parseLiteral(std::string_view literal) {
+        if (static_cast<std::size_t>(end - position) < literal.size()
+            || std::memcmp(position, literal.data(), literal.size()) != 0) {
+            return false;
+        }
+        position += literal.size();
+        return true;
+    }
+
+    bool parseValue(JsonValue& value, int depth) {
+        skipWhitespace();
+        if (position == end || depth > maxDepth) {
+            return false;
+        }
+
+        switch (*position) {
+        case '{':
+            return parseObject(value, depth);
+        case '[':
+            return parseArray(value, depth);
+        case '"':
+            value.type = JsonValue::Type::String;
+            return parseString(value.string);
+        case 't':
+            value.type = JsonValue::Type::Boolean;
+            value.boolean = true;
+            return parseLiteral("true");
+        case 'f':
+            value.type = JsonValue::Type::Boolean;
+            return parseLiteral("false");
+        case 'n':
+            return parseLiteral("null");
+        default:
+            return parseNumber(value);
+        }
+    }
+
+    bool parseNumber(JsonValue& value) {
+        const char* start = position;
+        bool integral = true;
+        while (position < end
+               && ((*position >= '0' && *position <= '9') || *position == '-' || *position == '+' || *position == '.'
+                   || *position == 'e' || *position == 'E')) {
+            integral = integral && *position != '.' && *position != 'e' && *position != 'E';
+            ++position;
+        }
+
+        const auto [last, error] = std::from_chars(start, position, value.number);
+        if (error != std::errc() || last != position) {
+            return false;
+        }
+        value.type = JsonValue::Type::Number;
+        value.integer = static_cast<std::int64_t>(value.number);
+        if (integral) {
+            std::from_chars(start, position, value.integer);
+        }
+        return true;
+    }
+
+    bool parseString(std::string_view& string) {
+        if (!consume('"')) {
+            return false;
+        }
+
+        const char* start = position;
+        bool escaped = false;
+        while (position < end && *position != '"') {
+            if (*position == '\\') {
+                escaped = true;
+                ++position;
+            }
+            ++position;
+        }
+        if (position >= end) {
+            return false;
+        }
+
+        string = std::string_view(start, position - start);
+        ++position;
+        if (escaped) {
+            string = unescape(string);
+        }
+        return true;
+    }
+
+    std::string_view unescape(std::string_view raw) {
+        char* decoded = arena.allocate<char>(raw.size());
+        std::size_t size = 0;
+        for (std::size_t i = 0; i < raw.size(); ++i) {
+            if (raw[i] != '\\' || i + 1 == raw.size()) {
+                decoded[size++] = raw[i];
+                continue;
+            }
+
+            switch (raw[++i]) {
+            case 'b':
+                decoded[size++] = '\b';
+                break;
+            case 'f':
+                decoded[size++] = '\f';
+                break;
+            case 'n':
+                decoded[size++] = '\n';
+                break;
+            case 'r':
+                decoded[size++] = '\r';
+                break;
+            case 't':
+                decoded[size++] = '\t';
+                break;
+            case 'u':
+                // Profiles never contain non-ASCII text, so code points are not decoded.
+                decoded[size++] = '?';
+                i = std::min(i + 4, raw.size() - 1);
+                break;
+            default:
+                decoded[size++] = raw[i];
+                break;
+            }
+        }
+        return std::string_view(decoded, size);
+    }
+
+    bool parseArray(JsonValue& value, int depth) {
+        consume('[');
+        ArenaVector<JsonValue> elements(arena);
+        elements.reserve(16);
+
+        if (!consume(']')) {
+            do {
+                if (!parseValue(elements.emplace_back(), depth + 1)) {
+                    return false;
+                }
+            } while (consume(','));
+
+            if (!consume(']')) {
+                return false;
+            }
+        }
+
+        value.type = JsonValue::Type::Array;
+        value.elements = elements.data();
+        value.size = elements.size();
+        return true;
+    }
+
+    bool parseObject(JsonValue& value, int depth) {
+        consume('{');
+        ArenaVector<std::string_view> keys(arena);
+        ArenaVector<JsonValue> elements(arena);
+        keys.reserve(16);
+        elements.reserve(16);
+
+        if (!consume('}')) {
+            do {
+                skipWhitespace();
+                if (!parseString(keys.emplace_back()) || !consume(':')
+                    || !parseValue(elements.emplace_back(), depth + 1)) {
+                    return false;
+                }
+            } while (consume(','));
+
+            if (!consume('}')) {
+                return false;
+            }
+        }
+
+        value.type = JsonValue::Type::Object;
+        value.keys = keys.data();
+        value.elements = elements.data();
+        value.size = elements.size();
+        return true;
+    }
+
+    const char* position;
+    const char* end;
+    Arena& arena;
+};
+
+std::string_view readFile(const char* filename, Arena& arena) {
+#if _WIN32
+    const HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                    FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return {};
+    }
+
+    LARGE_INTEGER fileSize;
+    DWORD bytesRead = 0;
+    char* contents = nullptr;
+    if (GetFileSizeEx(file, &fileSize)) {
+        contents = arena.allocate<char>(static_cast<std::size_t>(fileSize.QuadPart));
+        if (!ReadFile(file, contents, static_cast<DWORD>(fileSize.QuadPart), &bytesRead, nullptr)) {
+            bytesRead = 0;
+        }
+    }
+    CloseHandle(file);
+    return std::string_view(contents, bytesRead);
+#else
+    const int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return {};
+    }
+
+    struct stat status;
+    std::size_t size = 0;
+    if (fstat(fd, &status) == 0) {
+        char* contents = arena.allocate<char>(status.st_size);
+        while (size < static_cast<std::size_t>(status.st_size)) {
+            const auto n = read(fd, contents + size, status.st_size - size);
+            if (n <= 0) {
+                break;
+            }
+            size += n;
+        }
+        close(fd);
+        return std::string_view(contents, size);
+    }
+    close(fd);
+    return {};
+#endif
+}
+} // namespace
+
+const JsonValue& JsonValue::operator[](std::string_view key) const {
+    for (std::size_t i = 0; type == Type::Object && i < size; ++i) {
+        if (keys[i] == key) {
+            return elements[i];
+        }
+    }
+    return nullValue;
+}
+
+const JsonValue& JsonValue::operator[](std::size_t index) const {
+    return type == Type::Array && index < size ? elements[index] : nullValue;
+}
+
+bool JsonValue::contains(std::string_view key) const {
+    return &(*this)[key] != &nullValue;
+}
+
+const JsonValue* parseJson(std::string_view text, Arena& arena) {
+    auto* document = new (arena.allocate<JsonValue>(1)) JsonValue;
+    Parser parser(text, arena);
+    return parser.parseDocument(*document) ? document : nullptr;
+}
+
+const JsonValue* parseJsonFile(const char* filename, Arena& arena) {
+    const auto text = readFile(filename, arena);
+    return text.data() ? parseJson(text, arena) : nullptr;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "arena.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Read-only JSON document, just enough to load detector profiles. Every node, key and string lives in an Arena, so
+// reading a profile never calls malloc.
+struct JsonValue {
+    enum class Type { Null, Boolean, Number, String, Array, Object };
+
+    Type type = Type::Null;
+    bool boolean = false;
+    double number = 0;
+    // Exact value of integral numbers, which double cannot hold beyond 2^53.
+    std::int64_t integer = 0;
+    std::string_view string;
+    // Array elements, or object values matching `keys`.
+    const JsonValue* elements = nullptr;
+    const std::string_view* keys = nullptr;
+    std::size_t size = 0;
+
+    // Missing keys and out-of-range indices yield a null value.
+    const JsonValue& operator[](std::string_view key) const;
+    const JsonValue& operator[](std::size_t index) const;
+
+    bool contains(std::string_view key) const;
+
+    bool isNull() const {
+        return type == Type::Null;
+    }
+
+    bool isNumber() const {
+        return type == Type::Number;
+    }
+
+    bool isArray() const {
+        return type == Type::Array;
+    }
+
+    bool isObject() const {
+        return type == Type::Object;
+    }
+};
+
+// Returns nullptr if the text is not valid JSON.
+const JsonValue* parseJson(std::string_view text, Arena& arena);
+
+// Returns nullptr if the file cannot be read or is not valid JSON.
+const JsonValue* parseJsonFile(const char* filename, Arena& arena);
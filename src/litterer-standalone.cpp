@@ -1,27 +1,259 @@
 #include <litterer/litterer.h>
 
+#include <cerrno>
 #include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <mutex>
+#include <thread>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "allocation-trigger.h"
+#include "counters.h"
+#include "locality-probe.h"
+#include "memory-sampler.h"
+#include "profiler.h"
+#include "results.h"
+
+#if __linux__
+#include "fork-server.h"
+#include "stabilize.h"
+
+#include <dlfcn.h>
+#endif
 
 using Clock = std::chrono::steady_clock;
 
+namespace {
+// When to litter, from LITTER_TRIGGER. Littering at the start, before main, is the default.
+enum class Trigger { Start, Allocations, Seconds, Signal, Call };
+
+struct TriggerConfig {
+    Trigger trigger = Trigger::Start;
+    // Number of allocations, seconds, or signal number.
+    unsigned long long value = 0;
+};
+
+[[noreturn]] void triggerError(const char* message) {
+    std::fprintf(stderr, "[ERROR] %s\n", message);
+    std::exit(EXIT_FAILURE);
+}
+
+TriggerConfig triggerFromEnvironment() {
+    TriggerConfig config;
+    const char* env = std::getenv("LITTER_TRIGGER");
+    if (!env || std::strcmp(env, "start") == 0) {
+        return config;
+    }
+
+    const auto argument = [&](const char* prefix) -> const char* {
+        const std::size_t length = std::strlen(prefix);
+        return std::strncmp(env, prefix, length) == 0 ? env + length : nullptr;
+    };
+    if (const char* value = argument("allocations:")) {
+        config = {Trigger::Allocations, std::strtoull(value, nullptr, 10)};
+    } else if (const char* value = argument("seconds:")) {
+        config = {Trigger::Seconds, std::strtoull(value, nullptr, 10)};
+    } else if (std::strcmp(env, "signal") == 0) {
+        config = {Trigger::Signal, SIGUSR1};
+    } else if (const char* value = argument("signal:")) {
+        config = {Trigger::Signal, std::strtoull(value, nullptr, 10)};
+    } else if (std::strcmp(env, "call") == 0) {
+        config = {Trigger::Call, 0};
+    } else {
+        triggerError("LITTER_TRIGGER must be start, allocations:<n>, seconds:<t>, signal[:<number>] or call.");
+    }
+    return config;
+}
+
+TriggerConfig triggerConfig;
+std::mutex litterLock;
+int signalPipe[2] = {-1, -1};
+
+// Litters the heap, leaving the litter there for good. The first pass starts the locality probe, if enabled. The
+// allocations of every thread are ignored by liblitterer-trigger.so's hook meanwhile, including those of the producer
+// and consumer threads.
+void litter() {
+    if (ignoreAllocations) {
+        ignoreAllocations(true);
+    }
+    auto config = litterer::LitterConfig::fromEnvironment();
+    config.keepFreedSizes = localityProbeConfigured();
+    litterer::Litter litter(config);
+    litter.run();
+    recordLitterPass(litter);
+    startLocalityProbe(litter);
+    litter.leak();
+    if (ignoreAllocations) {
+        ignoreAllocations(false);
+    }
+}
+
+// One litter pass at a time.
+void litterPass() {
+    std::lock_guard<std::mutex> guard(litterLock);
+    litter();
+}
+
+// Runs a pass on the thread making the program's next allocation when liblitterer-trigger.so provides the malloc hook,
+// and on the calling thread otherwise.
+void dispatch() {
+    if (litterOnAllocation) {
+        litterOnAllocation(1, litterPass);
+    } else {
+        litterPass();
+    }
+}
+
+void onSignal(int) {
+    // Only async-signal-safe calls here: the pass itself runs on the trigger thread, or on the next malloc.
+    const char byte = 0;
+    [[maybe_unused]] const auto written = write(signalPipe[1], &byte, 1);
+}
+
+void* waitForTrigger(void*) {
+    if (triggerConfig.trigger == Trigger::Seconds) {
+        std::this_thread::sleep_for(std::chrono::seconds(triggerConfig.value));
+        dispatch();
+        return nullptr;
+    }
+
+    // Every signal litters again, appending its pass to the log.
+    for (;;) {
+        char byte;
+        const auto n = read(signalPipe[0], &byte, 1);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return nullptr;
+        }
+        dispatch();
+    }
+}
+
+// Seconds and signal triggers wait on their own thread, created with pthreads because std::thread would allocate.
+void startTriggerThread() {
+    if (triggerConfig.trigger == Trigger::Signal) {
+        if (pipe(signalPipe) != 0) {
+            triggerError("Could not create the signal pipe.");
+        }
+        struct sigaction action = {};
+        action.sa_handler = onSignal;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        if (sigaction(static_cast<int>(triggerConfig.value), &action, nullptr) != 0) {
+            triggerError("Could not install the LITTER_TRIGGER signal handler.");
+        }
+    }
+
+    pthread_t thread;
+    if (pthread_create(&thread, nullptr, waitForTrigger, nullptr) != 0) {
+        triggerError("Could not create the LITTER_TRIGGER thread.");
+    }
+    pthread_detach(thread);
+}
+} // namespace
+
+extern "C" void litterNow() {
+    litterPass();
+}
+
 struct Initialization {
     Initialization() {
-        runLitterer();
+#if __linux__
+        stabilize();
+#endif
+        configureLocalityProbe();
+        triggerConfig = triggerFromEnvironment();
+        if (std::getenv("LITTER_FORK_SERVER")
+            && (triggerConfig.trigger == Trigger::Seconds || triggerConfig.trigger == Trigger::Signal)) {
+            // Forked children would not inherit the trigger thread.
+            triggerError("LITTER_FORK_SERVER only works with the start, allocations and call triggers.");
+        }
+        if (std::getenv("LITTER_FORK_SERVER")
+            && (std::getenv("LITTER_SAMPLING") || std::getenv("LITTER_MEMORY_INTERVAL"))) {
+            // Nor the sampling threads.
+            triggerError("LITTER_SAMPLING and LITTER_MEMORY_INTERVAL cannot be combined with LITTER_FORK_SERVER.");
+        }
+
+        switch (triggerConfig.trigger) {
+        case Trigger::Start:
+            litter();
+            break;
+        case Trigger::Allocations:
+            if (!litterOnAllocation) {
+                triggerError("LITTER_TRIGGER=allocations:<n> needs liblitterer-trigger.so, which hooks malloc.");
+            }
+            litterOnAllocation(triggerConfig.value, litterPass);
+            break;
+        case Trigger::Seconds:
+        case Trigger::Signal:
+            startTriggerThread();
+            break;
+        case Trigger::Call:
+            break;
+        }
+        // The helper threads first, so that the inherited counters leave them out.
+        startMemorySampler();
+        startProfiler();
         programStart = Clock::now();
+        startCounters();
     }
 
     ~Initialization() {
         auto programEnd = Clock::now();
+        reportLocalityProbe();
         std::cerr << "==================================================================================" << std::endl;
         std::cerr << "Time elapsed: "
                   << std::chrono::duration_cast<std::chrono::milliseconds>(programEnd - programStart).count() / 1000.0
                   << std::endl;
+        reportCounters();
+        reportProfiler();
+        writeMemorySamples();
+        writeResults(std::chrono::duration_cast<std::chrono::nanoseconds>(programEnd - programStart).count());
         std::cerr << "==================================================================================" << std::endl;
     }
 
+    void restart() {
+        programStart = Clock::now();
+        startCounters();
+    }
+
   private:
     Clock::time_point programStart;
 };
 
 static Initialization _;
+
+#if __linux__
+namespace {
+using MainFunction = int (*)(int, char**, char**);
+MainFunction programMain = nullptr;
+
+// Replaces the program's main when LITTER_FORK_SERVER is set: only forked children get past serveForks.
+int forkServerMain(int argc, char** argv, char** envp) {
+    const auto request = serveForks(std::getenv("LITTER_FORK_SERVER"), argc, argv, envp);
+    _.restart();
+    return programMain(request.argc, request.argv, request.envp);
+}
+} // namespace
+
+extern "C" int __libc_start_main(MainFunction main, int argc, char** argv, void (*init)(), void (*fini)(),
+                                 void (*rtldFini)(), void* stackEnd) {
+    using LibcStartMain = decltype(&__libc_start_main);
+    static const auto next = reinterpret_cast<LibcStartMain>(dlsym(RTLD_NEXT, "__libc_start_main"));
+
+    if (std::getenv("LITTER_FORK_SERVER")) {
+        programMain = main;
+        main = forkServerMain;
+    }
+
+    return next(main, argc, argv, init, fini, rtldFini, stackEnd);
+}
+#endif
@@ -6,44 +6,399 @@
 #define NOMINMAX
 #endif
 #include <windows.h>
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#include <xmmintrin.h>
 #else
 #include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/resource.h>
 #include <unistd.h>
 #endif
 
+#if __linux__
+#include <sched.h>
+#include <sys/personality.h>
+#endif
+
 #include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cassert>
 #include <chrono>
+#include <cmath>
+#include <cstdarg>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
-#include <filesystem>
-#include <fstream>
+#include <cstring>
 #include <functional>
 #include <iterator>
+#include <limits>
 #include <random>
-#include <string>
+#include <span>
 #include <thread>
 #include <utility>
-#include <vector>
 
-#include <nlohmann/json.hpp>
+#include "allocator.h"
+#include "arena.h"
+#include "json-reader.h"
+#include "pages.h"
+#include "prefault.h"
+#include "spsc-queue.h"
+#include "threads.h"
 
 #define MALLOC ::malloc
 #define FREE ::free
+#define REALLOC ::realloc
+#define CALLOC ::calloc
+
+using litterer::FreeStrategy;
+using litterer::LitterConfig;
+using litterer::LitterStatistics;
+using litterer::PurgeMode;
+using litterer::TargetMetric;
+using litterer::TouchMode;
 
 namespace {
 using Clock = std::chrono::steady_clock;
 
+// Writes straight to a file descriptor: stdio streams would allocate their buffers with the malloc being littered.
+class Log {
+  public:
+    Log() = default;
+    Log(const Log&) = delete;
+    Log& operator=(const Log&) = delete;
+
+    ~Log() {
+        if (fd != stderrFd) {
+#if _WIN32
+            _close(fd);
+#else
+            close(fd);
+#endif
+        }
+    }
+
+    // Only the first log opened on each path in the process truncates the file; later ones append, so that a process
+    // littering more than once (run() again, litterNow(), triggers) keeps every pass.
+    void open(const char* filename) {
+        const bool truncate = firstOpen(filename);
+#if _WIN32
+        const int file = _open(filename, _O_WRONLY | _O_CREAT | _O_APPEND | (truncate ? _O_TRUNC : 0),
+                               _S_IREAD | _S_IWRITE);
+#else
+        const int file = ::open(filename, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC | (truncate ? O_TRUNC : 0), 0644);
+#endif
+        if (file >= 0) {
+            fd = file;
+        }
+    }
+
+    void print(const char* format, ...) {
+        char line[1024];
+        va_list arguments;
+        va_start(arguments, format);
+        const int size = vsnprintf(line, sizeof(line), format, arguments);
+        va_end(arguments);
+
+        if (size > 0) {
+#if _WIN32
+            _write(fd, line, static_cast<unsigned>(std::min<std::size_t>(size, sizeof(line) - 1)));
+#else
+            [[maybe_unused]] const auto written = write(fd, line, std::min<std::size_t>(size, sizeof(line) - 1));
+#endif
+        }
+    }
+
+  private:
+    // Records the path in a fixed table of FNV-1a hashes, without allocating, and returns whether it was not there yet.
+    // Once the table is full, further paths are appended to rather than truncated.
+    static bool firstOpen(const char* filename) {
+        std::uint64_t hash = 14695981039346656037ull;
+        for (const char* c = filename; *c; ++c) {
+            hash = (hash ^ static_cast<unsigned char>(*c)) * 1099511628211ull;
+        }
+        hash = hash ? hash : 1;
+
+        for (auto& slot : openedPaths) {
+            std::uint64_t expected = 0;
+            if (slot.compare_exchange_strong(expected, hash)) {
+                return true;
+            }
+            if (expected == hash) {
+                return false;
+            }
+        }
+        return false;
+    }
+
+    static constexpr int stderrFd = 2;
+    static constexpr std::size_t maxOpenedPaths = 64;
+    static inline std::atomic<std::uint64_t> openedPaths[maxOpenedPaths] = {};
+    int fd = stderrFd;
+};
+
 template <typename... T>
-void assertOrExit(bool condition, FILE* log, const std::string& message) {
+void assertOrExit(bool condition, Log& log, const char* format, T... arguments) {
     if (!condition) {
-        fprintf(log, "[ERROR] %s\n", message.c_str());
+        log.print("[ERROR] ");
+        log.print(format, arguments...);
+        log.print("\n");
         exit(EXIT_FAILURE);
     }
 }
 
-template <typename T, typename Generator>
-void partial_shuffle(std::vector<T>& v, std::size_t n, Generator& g) {
+// Sorts unsigned integers with a least significant digit radix sort, one byte at a time, skipping the bytes they all
+// share. `scratch` holds as many elements as `v`.
+template <typename T>
+void radix_sort(std::span<T> v, T* scratch) {
+    if (v.size() < 2) {
+        return;
+    }
+    T differing = 0;
+    for (const auto x : v) {
+        differing |= x ^ v[0];
+    }
+
+    T* from = v.data();
+    T* to = scratch;
+    for (unsigned shift = 0; shift < sizeof(T) * 8; shift += 8) {
+        if (((differing >> shift) & 0xff) == 0) {
+            continue;
+        }
+        std::size_t offsets[256] = {};
+        for (std::size_t i = 0; i < v.size(); ++i) {
+            ++offsets[(from[i] >> shift) & 0xff];
+        }
+        std::size_t sum = 0;
+        for (auto& offset : offsets) {
+            sum += std::exchange(offset, sum);
+        }
+        for (std::size_t i = 0; i < v.size(); ++i) {
+            to[offsets[(from[i] >> shift) & 0xff]++] = from[i];
+        }
+        std::swap(from, to);
+    }
+    if (from != v.data()) {
+        std::copy(from, from + v.size(), v.data());
+    }
+}
+
+// Litter objects are stored as 32-bit handles: their offset from a base address in units of the minimum malloc
+// alignment, which covers a 32 GiB window around the first object. Should an object fall outside of it, the table
+// switches to full pointers for the rest of the run.
+class ObjectTable {
+  public:
+    ObjectTable(Arena& arena, std::size_t capacity)
+        : arena(arena), capacity(capacity), handles(arena.allocate<std::uint32_t>(capacity)) {}
+
+    void push_back(void* object) {
+        assert(count < capacity);
+        if (count == 0) {
+            const auto address = reinterpret_cast<std::uintptr_t>(object);
+            // Centered on the first object: the window spans `window` handles of `granularity` bytes.
+            constexpr std::uintptr_t halfWindowBytes = window * granularity / 2;
+            base = (address > halfWindowBytes ? address - halfWindowBytes : 0) & ~(granularity - 1);
+        }
+        store(count++, object);
+    }
+
+    void replace(std::size_t i, void* object) {
+        assert(i < count);
+        store(i, object);
+    }
+
+    void* operator[](std::size_t i) const {
+        return reinterpret_cast<void*>(pointers ? pointers[i] : base + handles[i] * granularity);
+    }
+
+    std::size_t size() const {
+        return count;
+    }
+
+    bool compact() const {
+        return !pointers;
+    }
+
+    // Bytes reserved for objects not pushed yet, which have not been touched.
+    std::size_t unusedBytes() const {
+        return (capacity - count) * (pointers ? sizeof(std::uintptr_t) : sizeof(std::uint32_t));
+    }
+
+    // Sorts objects [first, last) by address. A radix sort: comparison sorts take minutes on billions of objects.
+    void sortByAddress(std::size_t first, std::size_t last, bool descending = false) {
+        visit([&](auto handles) {
+            using Handle = typename decltype(handles)::value_type;
+            const auto range = handles.subspan(first, last - first);
+            radix_sort(range, scratch<Handle>());
+            if (descending) {
+                std::reverse(range.begin(), range.end());
+            }
+        });
+    }
+
+    // Calls `f` with a span over the underlying handles or pointers. Both encodings preserve address order.
+    template <typename F>
+    void visit(F&& f) {
+        if (pointers) {
+            f(std::span(pointers, count));
+        } else {
+            f(std::span(handles, count));
+        }
+    }
+
+    // Address of an element of the span passed to visit().
+    template <typename T>
+    std::uintptr_t address(T element) const {
+        if constexpr (sizeof(T) == sizeof(std::uint32_t)) {
+            return base + element * granularity;
+        } else {
+            return element;
+        }
+    }
+
+  private:
+    static constexpr std::uintptr_t granularity = 8;
+    static constexpr std::uintptr_t window = std::uintptr_t{std::numeric_limits<std::uint32_t>::max()} + 1;
+
+    void store(std::size_t i, void* object) {
+        const auto address = reinterpret_cast<std::uintptr_t>(object);
+        if (!pointers) {
+            if (address >= base && (address - base) % granularity == 0 && (address - base) / granularity < window) {
+                handles[i] = static_cast<std::uint32_t>((address - base) / granularity);
+                return;
+            }
+            widen();
+        }
+        pointers[i] = address;
+    }
+
+    // A buffer as large as the table for radix_sort, mapped on first use.
+    template <typename T>
+    T* scratch() {
+        if (scratchBytes < capacity * sizeof(T)) {
+            scratchBuffer = arena.allocate<T>(capacity);
+            scratchBytes = capacity * sizeof(T);
+        }
+        return static_cast<T*>(scratchBuffer);
+    }
+
+    void widen() {
+        pointers = arena.allocate<std::uintptr_t>(capacity);
+        for (std::size_t i = 0; i < count; ++i) {
+            pointers[i] = base + handles[i] * granularity;
+        }
+    }
+
+    Arena& arena;
+    std::size_t capacity;
+    std::size_t count = 0;
+    std::uintptr_t base = 0;
+    std::uint32_t* handles;
+    std::uintptr_t* pointers = nullptr;
+    void* scratchBuffer = nullptr;
+    std::size_t scratchBytes = 0;
+};
+
+// Writes to a freshly allocated object like a program would, so that its pages become resident.
+void touch(void* object, std::size_t size, TouchMode mode) {
+    constexpr std::size_t cacheLineSize = 64;
+    auto* bytes = static_cast<volatile char*>(object);
+
+    switch (mode) {
+    case TouchMode::First:
+        bytes[0] = 0;
+        break;
+    case TouchMode::CacheLine:
+        for (std::size_t i = 0; i < size; i += cacheLineSize) {
+            bytes[i] = 0;
+        }
+        break;
+    case TouchMode::Full:
+        std::memset(object, 0, size);
+        break;
+    default:
+        break;
+    }
+}
+
+#if __linux__
+// The selected value of a sysfs setting such as "always [madvise] never".
+const char* selectedValue(char* setting) {
+    char* first = std::strchr(setting, '[');
+    char* last = first ? std::strchr(first, ']') : nullptr;
+    if (!last) {
+        return setting;
+    }
+    *last = '\0';
+    return first + 1;
+}
+
+// Formats a CPU set as a list such as "0,2-3".
+void formatCpuList(const cpu_set_t& cpus, char* buffer, std::size_t size) {
+    std::size_t used = 0;
+    buffer[0] = '\0';
+    for (int cpu = 0; cpu < CPU_SETSIZE && used < size; ++cpu) {
+        if (!CPU_ISSET(cpu, &cpus)) {
+            continue;
+        }
+        int last = cpu;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, &cpus)) {
+            ++last;
+        }
+        const int n = last == cpu ? std::snprintf(buffer + used, size - used, "%s%d", used ? "," : "", cpu)
+                                  : std::snprintf(buffer + used, size - used, "%s%d-%d", used ? "," : "", cpu, last);
+        if (n < 0) {
+            break;
+        }
+        used += n;
+        cpu = last;
+    }
+}
+
+// Logs what the run's timings depend on beyond the heap: where it runs, the CPU frequency governor, address space
+// randomization and transparent huge pages, with LitterConfig::logSystem. litterer-standalone can pin and derandomize
+// runs (LITTER_CPUS, LITTER_STABILIZE).
+void logSystem(Log& log) {
+    const int cpu = sched_getcpu();
+    cpu_set_t cpus;
+    char affinity[256] = "unknown";
+    if (sched_getaffinity(0, sizeof(cpus), &cpus) == 0) {
+        formatCpuList(cpus, affinity, sizeof(affinity));
+    }
+    char path[128];
+    std::snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_governor", cpu);
+    char governor[64];
+    if (!readSmallFile(path, governor, sizeof(governor))) {
+        std::strcpy(governor, "unknown");
+    }
+    log.print("cpu        : %d of %s, governor %s\n", cpu, affinity, governor);
+
+    const int persona = personality(0xffffffff);
+    log.print("aslr       : %s\n", persona == -1 ? "unknown" : (persona & ADDR_NO_RANDOMIZE) ? "off" : "on");
+
+    char enabled[128] = "unknown";
+    char defrag[128] = "unknown";
+    readSmallFile("/sys/kernel/mm/transparent_hugepage/enabled", enabled, sizeof(enabled));
+    readSmallFile("/sys/kernel/mm/transparent_hugepage/defrag", defrag, sizeof(defrag));
+    log.print("thp        : %s, defrag %s\n", selectedValue(enabled), selectedValue(defrag));
+}
+#endif
+
+std::int64_t pageFaults() {
+#if _WIN32
+    return -1;
+#else
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt + usage.ru_majflt;
+#endif
+}
+
+template <typename Range, typename Generator>
+void partial_shuffle(Range&& v, std::size_t n, Generator& g) {
     const auto m = std::min(n, v.size() - 2);
     for (std::size_t i = 0; i < m; ++i) {
         const auto j = std::uniform_int_distribution<std::size_t>(i, v.size() - 1)(g);
@@ -51,56 +406,1129 @@ void partial_shuffle(std::vector<T>& v, std::size_t n, Generator& g) {
     }
 }
 
-std::vector<std::uint64_t> cumulative_sum(const std::vector<std::uint64_t>& bins) {
-    std::vector<std::uint64_t> cumsum(bins.size());
+// Moves one randomly chosen object of every page (of `pageSize` bytes) holding litter to the back of the table, and
+// returns how many there are. Keeping those alive means no page can be returned to the OS or collapsed into a huge
+// page, which with 2 MiB pages models the fragmentation that defeats transparent huge pages.
+template <typename Generator>
+std::size_t pinPages(ObjectTable& objects, std::size_t pageSize, Generator& generator) {
+    std::size_t nPinned = 0;
+    objects.sortByAddress(0, objects.size());
+    objects.visit([&](auto handles) {
+        const auto page = [&](auto handle) { return objects.address(handle) / pageSize; };
+
+        // Pick each page's pinned object and swap it to the end of its page's run.
+        for (std::size_t end = handles.size(); end > 0;) {
+            std::size_t start = end - 1;
+            while (start > 0 && page(handles[start - 1]) == page(handles[end - 1])) {
+                --start;
+            }
+            std::swap(handles[std::uniform_int_distribution<std::size_t>(start, end - 1)(generator)], handles[end - 1]);
+            end = start;
+        }
+
+        // Move the pinned objects, the last of each run, to the back of the table.
+        auto lastPage = std::numeric_limits<std::uintptr_t>::max();
+        for (std::size_t i = handles.size(); i-- > 0;) {
+            const auto current = page(handles[i]);
+            if (current != lastPage) {
+                lastPage = current;
+                std::swap(handles[i], handles[handles.size() - ++nPinned]);
+            }
+        }
+    });
+    return nPinned;
+}
+
+ArenaVector<std::uint64_t> cumulative_sum(const ArenaVector<std::uint64_t>& bins) {
+    ArenaVector<std::uint64_t> cumsum(bins.size(), bins.get_allocator());
     std::partial_sum(bins.begin(), bins.end(), cumsum.begin());
     return cumsum;
 }
+
+// Draws object sizes following the detector's histogram.
+class SizeSampler {
+  public:
+    SizeSampler(const ArenaVector<std::uint64_t>& binsCumSum, std::uint64_t nAllocations)
+        : binsCumSum(binsCumSum), distribution(1, nAllocations) {}
+
+    template <typename Generator>
+    std::size_t operator()(Generator& generator) {
+        const auto offset = distribution(generator);
+        const auto it = std::lower_bound(binsCumSum.begin(), binsCumSum.end(), offset);
+        assert(it != binsCumSum.end());
+        return std::distance(binsCumSum.begin(), it) + 1;
+    }
+
+  private:
+    const ArenaVector<std::uint64_t>& binsCumSum;
+    std::uniform_int_distribution<std::uint64_t> distribution;
+};
+
+// Draws litter sizes ahead of the allocation loop, a batch at a time, splitting each batch across threads. Every slice
+// of a batch has its own generator seeded from the seed and the slice's index, so the sizes do not depend on the number
+// of threads.
+class SizeBatches {
+  public:
+    SizeBatches(Arena& arena, const SizeSampler& sampler, std::uint64_t seed, unsigned nThreads)
+        : sampler(sampler), seed(seed), nThreads(nThreads), sizes(arena.allocate<std::uint32_t>(batchSize)) {}
+
+    // Draws the next min(n, batch size) sizes.
+    std::span<const std::uint32_t> next(std::size_t n) {
+        const std::size_t count = std::min(n, batchSize);
+        const std::size_t nSlices = (count + sliceSize - 1) / sliceSize;
+        const auto nWorkers = static_cast<unsigned>(std::min<std::size_t>(nThreads, nSlices));
+        runOnThreads(nWorkers, [&](unsigned worker) {
+            SizeSampler local = sampler;
+            for (std::size_t slice = worker; slice < nSlices; slice += nWorkers) {
+                std::mt19937_64 generator(seed ^ ((firstSlice + slice + 1) * 0x9e3779b97f4a7c15));
+                const std::size_t end = std::min(count, (slice + 1) * sliceSize);
+                for (std::size_t i = slice * sliceSize; i < end; ++i) {
+                    sizes[i] = static_cast<std::uint32_t>(local(generator));
+                }
+            }
+        });
+        firstSlice += nSlices;
+        return {sizes, count};
+    }
+
+  private:
+    static constexpr std::size_t sliceSize = std::size_t{1} << 16;
+    static constexpr std::size_t batchSize = std::size_t{1} << 22;
+
+    const SizeSampler& sampler;
+    std::uint64_t seed;
+    unsigned nThreads;
+    std::uint32_t* sizes;
+    std::size_t firstSlice = 0;
+};
+
+inline void prefetch(const void* address) {
+#if _WIN32
+    _mm_prefetch(static_cast<const char*>(address), _MM_HINT_T0);
+#else
+    __builtin_prefetch(address, 1);
+#endif
+}
+
+// Frees objects [first, last) of the table in chunks, prefetching each chunk before freeing it: on large heaps the
+// frees are dominated by cache and TLB misses on the objects and their headers.
+void freeObjects(const ObjectTable& objects, std::size_t first, std::size_t last) {
+    constexpr std::size_t chunkSize = 256;
+    void* chunk[chunkSize];
+    for (std::size_t start = first; start < last; start += chunkSize) {
+        const std::size_t n = std::min(chunkSize, last - start);
+        for (std::size_t i = 0; i < n; ++i) {
+            chunk[i] = objects[start + i];
+            prefetch(chunk[i]);
+        }
+        for (std::size_t i = 0; i < n; ++i) {
+            FREE(chunk[i]);
+        }
+    }
+}
+
+// Charges the wall-clock time spent in each step of littering to the statistics' steps, logged as a breakdown once it
+// is done.
+class StepTimes {
+  public:
+    explicit StepTimes(LitterStatistics& stats) : stats(stats), last(std::chrono::high_resolution_clock::now()) {}
+
+    // Charges the time since the previous lap to `step`, a string literal.
+    void lap(const char* step) {
+        const auto now = std::chrono::high_resolution_clock::now();
+        const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(now - last).count();
+        last = now;
+
+        std::size_t i = 0;
+        while (i < stats.nSteps && stats.steps[i].name != step) {
+            ++i;
+        }
+        if (i == stats.nSteps) {
+            if (stats.nSteps == LitterStatistics::maxSteps) {
+                return;
+            }
+            stats.steps[stats.nSteps++].name = step;
+        }
+        stats.steps[i].nanoseconds += elapsed;
+    }
+
+    double totalMilliseconds() const {
+        std::uint64_t total = 0;
+        for (std::size_t i = 0; i < stats.nSteps; ++i) {
+            total += stats.steps[i].nanoseconds;
+        }
+        return total / 1e6;
+    }
+
+    // Writes "step: x ms, ..." into `buffer`.
+    void format(char* buffer, std::size_t size) const {
+        std::size_t used = 0;
+        buffer[0] = '\0';
+        for (std::size_t i = 0; i < stats.nSteps && used < size; ++i) {
+            const int n = std::snprintf(buffer + used, size - used, "%s%s: %.1f ms", i ? ", " : "",
+                                        stats.steps[i].name, stats.steps[i].nanoseconds / 1e6);
+            if (n < 0) {
+                break;
+            }
+            used += n;
+        }
+    }
+
+  private:
+    LitterStatistics& stats;
+    std::chrono::high_resolution_clock::time_point last;
+};
+
+// Finds a phase of the profile by name, by index, or "last" for the phase the program ended in, which for a service is
+// its steady state. Returns nullptr if there is no such phase.
+const JsonValue* findPhase(const JsonValue& data, const char* name) {
+    const JsonValue& phases = data["Phases"];
+    if (!phases.isArray() || phases.size == 0) {
+        return nullptr;
+    }
+    if (std::strcmp(name, "last") == 0) {
+        return &phases[phases.size - 1];
+    }
+    for (std::size_t i = 0; i < phases.size; ++i) {
+        if (phases[i]["Name"].string == name) {
+            return &phases[i];
+        }
+    }
+
+    char* end = nullptr;
+    const auto index = std::strtoull(name, &end, 10);
+    return (*name && *end == '\0' && index < phases.size) ? &phases[index] : nullptr;
+}
+
+// One profile of a mixture, as in LITTER_DATA_FILENAME=a.out:0.7,b.out:0.3.
+struct ProfileComponent {
+    const char* filename = nullptr;
+    // Scales the component's MaxLiveAllocations.
+    double weight = 1;
+    const JsonValue* data = nullptr;
+    // The phase littered from, or the whole run.
+    const JsonValue* profile = nullptr;
+};
+
+// Splits a comma-separated list of profiles, each optionally followed by :<weight>, in a copy of it in the arena. A
+// suffix that is not a number belongs to the filename. Returns false on an empty filename or a weight that is not
+// positive.
+bool parseProfileList(const char* list, Arena& arena, ArenaVector<ProfileComponent>& components) {
+    const std::size_t length = std::strlen(list);
+    char* copy = arena.allocate<char>(length + 1);
+    std::memcpy(copy, list, length + 1);
+    components.reserve(std::count(copy, copy + length, ',') + 1);
+
+    for (char* item = copy; item;) {
+        char* next = std::strchr(item, ',');
+        if (next) {
+            *next++ = '\0';
+        }
+
+        ProfileComponent component;
+        component.filename = item;
+        if (char* colon = std::strrchr(item, ':')) {
+            char* end = nullptr;
+            const double weight = std::strtod(colon + 1, &end);
+            if (end != colon + 1 && *end == '\0') {
+                if (!(weight > 0)) {
+                    return false;
+                }
+                *colon = '\0';
+                component.weight = weight;
+            }
+        }
+        if (*item == '\0') {
+            return false;
+        }
+        components.push_back(component);
+        item = next;
+    }
+    return true;
+}
+
+// Merges the components' size histograms into one for a single sampler. Each component is scaled to its share of the
+// litter, weight * MaxLiveAllocations, so sizes are drawn as if each component had allocated its own live objects. A
+// lone profile keeps its counts.
+ArenaVector<std::uint64_t> mixtureBins(Arena& arena, std::span<const ProfileComponent> components) {
+    ArenaVector<std::uint64_t> bins(arena);
+    std::size_t nBins = 0;
+    double totalLive = 0;
+    for (const auto& component : components) {
+        const JsonValue& profile = *component.profile;
+        nBins = std::max(nBins, profile["Bins"].size);
+        totalLive += component.weight * profile["MaxLiveAllocations"].integer;
+    }
+    bins.resize(nBins);
+
+    // Fixed point probabilities: the merged counts add up to about 2^48.
+    constexpr double scale = 1ull << 48;
+    for (const auto& component : components) {
+        const JsonValue& profile = *component.profile;
+        const double share = component.weight * profile["MaxLiveAllocations"].integer / totalLive;
+        const double nAllocations = profile["NAllocations"].integer;
+        for (std::size_t i = 0; i < profile["Bins"].size; ++i) {
+            const auto count = profile["Bins"][i].integer;
+            bins[i] += components.size() == 1
+                           ? count
+                           : static_cast<std::uint64_t>(std::llround(count / nAllocations * share * scale));
+        }
+    }
+    return bins;
+}
+
+struct ApiCounts {
+    std::size_t calls[4] = {};
+};
+
+// Replays the detector's mix of allocation APIs, and of alignments for the aligned ones, per power-of-two size class:
+// calloc can take zeroed-page shortcuts, and aligned allocations take their own paths and leave padding holes.
+class ApiSampler {
+  public:
+    enum Api { Malloc, Calloc, PosixMemalign, AlignedAlloc, NApis };
+    static constexpr const char* names[NApis] = {"malloc", "calloc", "posix_memalign", "aligned_alloc"};
+
+    explicit ApiSampler(const JsonValue& data) {
+        const JsonValue& apiMix = data["ApiMix"];
+        const JsonValue& alignments = data["Alignments"];
+        if (apiMix.size != nSizeClasses || alignments.size != nSizeClasses) {
+            return;
+        }
+        for (std::size_t row = 0; row < nSizeClasses; ++row) {
+            std::uint64_t sum = 0;
+            for (std::size_t i = 0; i < NApis; ++i) {
+                sum += apiMix[row][i].integer;
+                apiCumSum[row][i] = sum;
+            }
+            nCalls += sum;
+            sum = 0;
+            for (std::size_t i = 0; i < nAlignmentBins; ++i) {
+                sum += alignments[row][i].integer;
+                alignmentCumSum[row][i] = sum;
+            }
+        }
+    }
+
+    // False if the profile predates the API mix.
+    bool available() const {
+        return nCalls != 0;
+    }
+
+    // Allocates `size` bytes through an API drawn from the size class's mix. Sets `aligned` if it was an aligned one.
+    template <typename Generator>
+    void* operator()(Generator& generator, std::size_t size, ApiCounts& counts, bool& aligned) {
+        const std::size_t row = std::min<std::size_t>(std::bit_width(size - 1), nSizeClasses - 1);
+        const auto api = static_cast<Api>(draw(apiCumSum[row], generator));
+        ++counts.calls[api];
+        aligned = false;
+
+        switch (api) {
+        case Calloc:
+            return CALLOC(1, size);
+#if !_WIN32
+        // Windows has neither, and _aligned_malloc needs its own free: these fall back to malloc there.
+        case PosixMemalign:
+        case AlignedAlloc: {
+            const std::size_t alignment
+                = std::max(sizeof(void*), std::size_t{1} << draw(alignmentCumSum[row], generator));
+            aligned = true;
+            if (api == AlignedAlloc) {
+                // aligned_alloc wants a multiple of the alignment.
+                return ::aligned_alloc(alignment, (size + alignment - 1) & ~(alignment - 1));
+            }
+            void* pointer = nullptr;
+            return ::posix_memalign(&pointer, alignment, size) == 0 ? pointer : nullptr;
+        }
+#endif
+        default:
+            return MALLOC(size);
+        }
+    }
+
+  private:
+    static constexpr std::size_t nSizeClasses = 13;
+    static constexpr std::size_t nAlignmentBins = 16;
+
+    // Index drawn from a row of cumulative counts; 0 if the row is empty.
+    template <std::size_t N, typename Generator>
+    static std::size_t draw(const std::uint64_t (&cumsum)[N], Generator& generator) {
+        if (cumsum[N - 1] == 0) {
+            return 0;
+        }
+        const auto offset = std::uniform_int_distribution<std::uint64_t>(1, cumsum[N - 1])(generator);
+        return std::lower_bound(cumsum, cumsum + N, offset) - cumsum;
+    }
+
+    std::uint64_t apiCumSum[nSizeClasses][NApis] = {};
+    std::uint64_t alignmentCumSum[nSizeClasses][nAlignmentBins] = {};
+    std::uint64_t nCalls = 0;
+};
+
+struct ReallocCounts {
+    std::size_t chains = 0;
+    std::size_t reallocs = 0;
+    std::size_t moved = 0;
+};
+
+// Replays the realloc growth chains recorded by the detector: a chain starts with a malloc of a sampled size, then
+// grows (or shrinks) by a sampled factor at each of a sampled number of reallocs, like a vector or string buffer.
+class ReallocChainSampler {
+  public:
+    ReallocChainSampler(Arena& arena, const JsonValue& data)
+        : startSizes(cumulativeBins(arena, data["ReallocStartSizes"])),
+          growthFactors(cumulativeBins(arena, data["ReallocGrowthFactors"])),
+          chainLengths(cumulativeBins(arena, data["ReallocChainLengths"])),
+          factorSteps(data["GrowthFactorSteps"].isNumber() ? data["GrowthFactorSteps"].number : 8),
+          startSizeSampler(startSizes, std::max<std::uint64_t>(1, total(startSizes))),
+          growthFactorSampler(growthFactors, std::max<std::uint64_t>(1, total(growthFactors))),
+          chainLengthSampler(chainLengths, std::max<std::uint64_t>(1, total(chainLengths))) {
+        // Allocations in the profile also count reallocs, which do not start an object.
+        const auto nAllocations = data["NAllocations"].integer - data["NReallocs"].integer;
+        fraction = nAllocations > 0 ? static_cast<double>(total(startSizes)) / nAllocations : 0;
+    }
+
+    ReallocChainSampler(const ReallocChainSampler&) = delete;
+    ReallocChainSampler& operator=(const ReallocChainSampler&) = delete;
+
+    // False if the profile predates realloc chains, or the program never reallocated.
+    bool available() const {
+        return total(startSizes) && total(growthFactors) && total(chainLengths);
+    }
+
+    // Fraction of the program's allocations that went on to start a realloc chain.
+    double chainFraction() const {
+        return fraction;
+    }
+
+    // Replays one chain, returning the final object and setting `size` to its size.
+    template <typename Generator>
+    void* operator()(Generator& generator, std::size_t& size, ReallocCounts& counts) {
+        size = startSizeSampler(generator);
+        void* pointer = MALLOC(size);
+
+        const auto length = chainLengthSampler(generator);
+        for (std::size_t i = 0; i < length; ++i) {
+            const double factor = (growthFactorSampler(generator) - 1) / factorSteps;
+            size = std::max<std::size_t>(1, static_cast<std::size_t>(size * factor));
+            void* moved = REALLOC(pointer, size);
+            counts.moved += moved != pointer;
+            pointer = moved;
+        }
+        counts.reallocs += length;
+        ++counts.chains;
+        return pointer;
+    }
+
+  private:
+    static ArenaVector<std::uint64_t> cumulativeBins(Arena& arena, const JsonValue& value) {
+        ArenaVector<std::uint64_t> bins(arena);
+        bins.reserve(value.size);
+        for (std::size_t i = 0; i < value.size; ++i) {
+            bins.push_back(value[i].integer);
+        }
+        return cumulative_sum(bins);
+    }
+
+    static std::uint64_t total(const ArenaVector<std::uint64_t>& cumsum) {
+        return cumsum.empty() ? 0 : cumsum.back();
+    }
+
+    ArenaVector<std::uint64_t> startSizes;
+    ArenaVector<std::uint64_t> growthFactors;
+    ArenaVector<std::uint64_t> chainLengths;
+    double factorSteps;
+    double fraction;
+    SizeSampler startSizeSampler;
+    SizeSampler growthFactorSampler;
+    SizeSampler chainLengthSampler;
+};
+
+// Replays `nChains` realloc chains, keeping every object alive until the end so that each chain grows among the
+// others, then frees them all. Returns the fraction of reallocs that moved their object.
+template <typename Generator>
+double reallocMoveRate(Arena& arena, ReallocChainSampler& chains, std::size_t nChains, Generator& generator) {
+    void** pointers = arena.allocate<void*>(nChains);
+    ReallocCounts counts;
+    for (std::size_t i = 0; i < nChains; ++i) {
+        std::size_t size;
+        pointers[i] = chains(generator, size, counts);
+    }
+    for (std::size_t i = 0; i < nChains; ++i) {
+        FREE(pointers[i]);
+    }
+    return counts.reallocs ? static_cast<double>(counts.moved) / counts.reallocs : 0;
+}
+
+// Parses "<metric>:<value>", as in LITTER_TARGET and LITTER_CONVERGENCE.
+bool parseMetric(const char* text, TargetMetric& metric, double& value) {
+    const char* separator = std::strchr(text, ':');
+    if (!separator) {
+        return false;
+    }
+    for (const auto candidate : {TargetMetric::ResidentMegabytes, TargetMetric::PartialPages,
+                                 TargetMetric::FragmentationRatio, TargetMetric::HeapSpanMegabytes}) {
+        const char* name = targetMetricName(candidate);
+        if (std::strncmp(text, name, separator - text) == 0 && name[separator - text] == '\0') {
+            metric = candidate;
+            value = atof(separator + 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Keeps, for every page holding litter, how many litter objects start on it and how many the litterer freed there, so
+// that the fraction of partially occupied pages (live litter next to a hole) follows every malloc and free without
+// re-sorting the objects. Pages are kept in an open-addressing table sized for `nObjects` distinct pages.
+class PageOccupancy {
+  public:
+    PageOccupancy(Arena& arena, std::size_t nObjects, std::size_t pageSize)
+        : pageShift(std::countr_zero(pageSize)), mask(std::bit_ceil(2 * nObjects + 1) - 1),
+          slots(arena.allocate<Slot>(mask + 1)) {
+        std::fill(slots, slots + mask + 1, Slot{});
+    }
+
+    void allocated(void* object) {
+        Slot& slot = find(object);
+        const Slot before = slot;
+        ++slot.live;
+        update(before, slot);
+    }
+
+    void freed(void* object) {
+        Slot& slot = find(object);
+        const Slot before = slot;
+        --slot.live;
+        ++slot.holes;
+        update(before, slot);
+    }
+
+    double partialFraction() const {
+        return nPages ? static_cast<double>(nPartial) / nPages : 0;
+    }
+
+  private:
+    struct Slot {
+        // Page number plus one, so that 0 marks an empty slot.
+        std::uintptr_t key = 0;
+        std::uint32_t live = 0;
+        std::uint32_t holes = 0;
+    };
+
+    Slot& find(void* object) {
+        const std::uintptr_t key = (reinterpret_cast<std::uintptr_t>(object) >> pageShift) + 1;
+        for (std::size_t i = (key * 0x9e3779b97f4a7c15) & mask;; i = (i + 1) & mask) {
+            if (slots[i].key == key) {
+                return slots[i];
+            }
+            if (slots[i].key == 0) {
+                slots[i].key = key;
+                return slots[i];
+            }
+        }
+    }
+
+    void update(const Slot& before, const Slot& after) {
+        const auto partial = [](const Slot& slot) { return slot.live && slot.holes; };
+        nPages += (after.live != 0) - (before.live != 0);
+        nPartial += partial(after) - partial(before);
+    }
+
+    int pageShift;
+    std::size_t mask;
+    Slot* slots;
+    std::ptrdiff_t nPages = 0;
+    std::ptrdiff_t nPartial = 0;
+};
+
+struct AlignmentWaste {
+    std::size_t nAligned = 0;
+    double alignedGap = 0;
+    double otherGap = 0;
+    std::size_t bytes = 0;
+};
+
+// Estimates the alignment padding among the live litter, objects [first, size): walking them in address order, the gap
+// from the end of one object to the start of the next is wider before aligned objects, where allocators leave padding.
+// The excess of their mean gap over that of other objects, times their number, is the waste. Gaps of a page or more
+// are taken as discontinuities rather than padding. `aligned` holds the sorted addresses of aligned objects.
+AlignmentWaste alignmentWaste(ObjectTable& objects, std::size_t first, std::span<const std::uintptr_t> aligned,
+                              const Allocator& allocator) {
+    constexpr std::uintptr_t maxGap = 4096;
+    AlignmentWaste result;
+    std::size_t nOther = 0;
+    double alignedGaps = 0;
+    double otherGaps = 0;
+
+    objects.sortByAddress(first, objects.size());
+    objects.visit([&](auto handles) {
+        const auto live = handles.subspan(first);
+
+        std::size_t next = 0;
+        std::uintptr_t previousEnd = 0;
+        for (const auto handle : live) {
+            const auto address = objects.address(handle);
+            while (next < aligned.size() && aligned[next] < address) {
+                ++next;
+            }
+            const bool isAligned = next < aligned.size() && aligned[next] == address;
+
+            if (previousEnd && address >= previousEnd && address - previousEnd < maxGap) {
+                const auto gap = static_cast<double>(address - previousEnd);
+                if (isAligned) {
+                    alignedGaps += gap;
+                    ++result.nAligned;
+                } else {
+                    otherGaps += gap;
+                    ++nOther;
+                }
+            }
+            previousEnd = address + allocator.usableSize(reinterpret_cast<void*>(address));
+        }
+    });
+
+    result.alignedGap = result.nAligned ? alignedGaps / result.nAligned : 0;
+    result.otherGap = nOther ? otherGaps / nOther : 0;
+    result.bytes = static_cast<std::size_t>(std::max(0.0, result.alignedGap - result.otherGap) * result.nAligned);
+    return result;
+}
+
+struct TargetResult {
+    std::size_t rounds = 0;
+    double measured = 0;
+    bool reached = false;
+};
+
+// Litters in rounds until `measure()` reaches `target`, or `maxObjects` objects have been allocated. Each round
+// allocates a batch and frees a random `1 - occupancy` of it, moving the freed objects to the front of the table and
+// counting them in `nFreed`. Like guess() in the page microbenchmark, the next round's size extrapolates linearly from
+// the progress so far, at most doubling the litter at each round.
+template <typename Measure, typename Allocate, typename Free, typename Generator>
+TargetResult litterToTarget(ObjectTable& objects, std::size_t& nFreed, std::size_t maxObjects, std::size_t firstBatch,
+                            double occupancy, double target, Measure&& measure, Allocate&& allocate, Free&& free,
+                            Generator& generator, Log& log) {
+    TargetResult result;
+    const double baseline = measure();
+    const std::size_t minBatch = std::max<std::size_t>(1, firstBatch / 8);
+    std::size_t batch = std::max(firstBatch, minBatch);
+
+    while (objects.size() < maxObjects) {
+        const std::size_t start = objects.size();
+        batch = std::min(batch, maxObjects - start);
+        for (std::size_t i = 0; i < batch; ++i) {
+            objects.push_back(allocate());
+        }
+
+        const auto nFree = static_cast<std::size_t>((1 - occupancy) * batch);
+        objects.visit([&](auto handles) {
+            const auto fresh = handles.subspan(start);
+            if (fresh.size() >= 2) {
+                partial_shuffle(fresh, nFree, generator);
+            }
+            for (std::size_t i = 0; i < nFree; ++i) {
+                std::swap(handles[nFreed + i], fresh[i]);
+            }
+        });
+        for (std::size_t i = 0; i < nFree; ++i) {
+            free(objects[nFreed + i]);
+        }
+        nFreed += nFree;
+
+        ++result.rounds;
+        result.measured = measure();
+        log.print("Round %zu: %zu object(s) allocated, %zu freed, measured %g.\n", result.rounds, objects.size(),
+                  nFreed, result.measured);
+        if (result.measured >= target) {
+            result.reached = true;
+            break;
+        }
+
+        const double progress = result.measured - baseline;
+        const std::size_t estimate = progress > 0 ? static_cast<std::size_t>(objects.size() * (target - baseline)
+                                                                             / progress)
+                                                  : 2 * objects.size();
+        batch = std::clamp(estimate > objects.size() ? estimate - objects.size() : 0, minBatch, objects.size());
+    }
+    return result;
+}
+
+struct GenerationResult {
+    std::size_t generations = 0;
+    double measured = 0;
+    bool converged = false;
+};
+
+// Ages the live litter, objects [first, last), like a long-running program: each generation frees `churn` of them,
+// chosen by the free strategy, and allocates as many new objects in their place. Stops once `measure()` changes by
+// less than the tolerance (relative) over as many generations as it takes to turn the live set over, or after the
+// maximum number of generations. Comparing single generations would stop too early at low churn.
+template <typename Measure, typename Allocate, typename Generator>
+GenerationResult churnGenerations(ObjectTable& objects, std::size_t first, std::size_t last,
+                                  const litterer::LitterGenerations& config, FreeStrategy strategy, Measure&& measure,
+                                  Allocate&& allocate, Generator& generator, Log& log) {
+    GenerationResult result;
+    const std::size_t nChurn = static_cast<std::size_t>(config.churn * (last - first));
+    if (nChurn == 0 || last - first < 2) {
+        return result;
+    }
+
+    constexpr std::size_t maxTurnover = 64;
+    const std::size_t turnover = std::min<std::size_t>(maxTurnover, std::ceil(1 / config.churn));
+    // Measurements of the last `turnover` generations, all starting from the initial one.
+    double history[maxTurnover];
+    std::fill(history, history + maxTurnover, measure());
+
+    while (result.generations < config.maxGenerations) {
+        objects.visit([&](auto handles) {
+            const auto live = handles.subspan(first, last - first);
+            if (strategy == FreeStrategy::HighestAddresses) {
+                std::nth_element(live.begin(), live.begin() + (nChurn - 1), live.end(), std::greater<>());
+            } else {
+                partial_shuffle(live, nChurn, generator);
+            }
+        });
+        for (std::size_t i = first; i < first + nChurn; ++i) {
+            FREE(objects[i]);
+        }
+        for (std::size_t i = first; i < first + nChurn; ++i) {
+            objects.replace(i, allocate());
+        }
+
+        ++result.generations;
+        result.measured = measure();
+        const double before = history[result.generations % turnover];
+        history[result.generations % turnover] = result.measured;
+
+        const double change = before ? (result.measured - before) / before : 0;
+        log.print("Generation %zu: measured %g (%+.2f%% over %zu generation(s)).\n", result.generations,
+                  result.measured, change * 100, std::min(result.generations, turnover));
+        if (result.generations >= turnover && std::abs(change) < config.tolerance) {
+            result.converged = true;
+            break;
+        }
+    }
+    return result;
+}
+
+struct CrossThreadResult {
+    std::size_t remoteFrees = 0;
+    std::size_t localFrees = 0;
+};
+
+// Producer threads allocate the litter and pass the objects to be freed to consumer threads through one SPSC queue per
+// producer/consumer pair, so that they go through the allocator's remote-free paths like in a request pipeline. Which
+// objects are freed is decided online by selection sampling, so that each producer frees exactly its share, uniformly
+// at random. Survivors are appended to `objects`.
+CrossThreadResult litterAcrossThreads(Arena& arena, ObjectTable& objects, const SizeSampler& sampler,
+                                      std::size_t nObjects, std::size_t nObjectsToBeFreed,
+                                      const LitterConfig& config, std::uint32_t seed) {
+    constexpr std::size_t queueCapacity = 4096;
+    const unsigned nProducers = config.producers;
+    const unsigned nConsumers = config.consumers;
+
+    auto* queues = arena.allocate<SpscQueue<void*>>(nProducers * nConsumers);
+    for (unsigned i = 0; i < nProducers * nConsumers; ++i) {
+        new (&queues[i]) SpscQueue<void*>(arena.allocate<void*>(queueCapacity), queueCapacity);
+    }
+
+    struct alignas(64) Counters {
+        void** survivors;
+        std::size_t nSurvivors;
+        std::size_t nFrees;
+    };
+    auto* producers = arena.allocate<Counters>(nProducers);
+    auto* consumers = arena.allocate<Counters>(nConsumers);
+    for (unsigned i = 0; i < nProducers; ++i) {
+        producers[i] = {arena.allocate<void*>(nObjects / nProducers + 1), 0, 0};
+    }
+    for (unsigned i = 0; i < nConsumers; ++i) {
+        consumers[i] = {nullptr, 0, 0};
+    }
+
+    const auto produce = [&](unsigned i) {
+        auto& counters = producers[i];
+        SizeSampler sizes = sampler;
+        std::mt19937_64 generator(seed + 0x9e3779b97f4a7c15 * (i + 1));
+        std::uniform_real_distribution<double> remote(0, 1);
+
+        const std::size_t n = nObjects / nProducers + (i < nObjects % nProducers);
+        std::size_t toBeFreed = nObjectsToBeFreed / nProducers + (i < nObjectsToBeFreed % nProducers);
+        unsigned consumer = 0;
+
+        for (std::size_t k = 0; k < n; ++k) {
+            const auto size = sizes(generator);
+            void* pointer = MALLOC(size);
+            touch(pointer, size, config.touch);
+
+            if (std::uniform_int_distribution<std::size_t>(0, n - k - 1)(generator) >= toBeFreed) {
+                counters.survivors[counters.nSurvivors++] = pointer;
+                continue;
+            }
+
+            --toBeFreed;
+            if (remote(generator) >= config.remoteFraction) {
+                FREE(pointer);
+                ++counters.nFrees;
+                continue;
+            }
+
+            auto& queue = queues[i * nConsumers + consumer];
+            consumer = (consumer + 1) % nConsumers;
+            while (!queue.tryPush(pointer)) {
+                std::this_thread::yield();
+            }
+        }
+
+        for (unsigned j = 0; j < nConsumers; ++j) {
+            queues[i * nConsumers + j].close();
+        }
+    };
+
+    const auto consume = [&](unsigned j) {
+        auto& counters = consumers[j];
+        for (;;) {
+            bool popped = false;
+            bool drained = true;
+            for (unsigned i = 0; i < nProducers; ++i) {
+                auto& queue = queues[i * nConsumers + j];
+                void* pointer;
+                while (queue.tryPop(pointer)) {
+                    FREE(pointer);
+                    ++counters.nFrees;
+                    popped = true;
+                }
+                drained = drained && queue.drained();
+            }
+
+            if (drained) {
+                break;
+            }
+            if (!popped) {
+                std::this_thread::yield();
+            }
+        }
+    };
+
+    runOnThreads(nProducers + nConsumers, [&](unsigned i) {
+        if (i < nProducers) {
+            produce(i);
+        } else {
+            consume(i - nProducers);
+        }
+    });
+
+    CrossThreadResult result;
+    for (unsigned i = 0; i < nProducers; ++i) {
+        for (std::size_t k = 0; k < producers[i].nSurvivors; ++k) {
+            objects.push_back(producers[i].survivors[k]);
+        }
+        result.localFrees += producers[i].nFrees;
+    }
+    for (unsigned j = 0; j < nConsumers; ++j) {
+        result.remoteFrees += consumers[j].nFrees;
+    }
+    return result;
+}
 } // namespace
 
 void runLitterer() {
-    FILE* log = stderr;
+    litterer::Litter litter(LitterConfig::fromEnvironment());
+    litter.run();
+    // The litter stays on the heap of the program being benchmarked; only the bookkeeping is unmapped.
+    litter.leak();
+}
+
+namespace litterer {
+const char* freeStrategyName(FreeStrategy strategy) {
+    switch (strategy) {
+    case FreeStrategy::HighestAddresses:
+        return "highest";
+    case FreeStrategy::PinPages:
+        return "pin";
+    default:
+        return "random";
+    }
+}
+
+const char* touchModeName(TouchMode mode) {
+    switch (mode) {
+    case TouchMode::First:
+        return "first";
+    case TouchMode::CacheLine:
+        return "line";
+    case TouchMode::Full:
+        return "full";
+    default:
+        return "none";
+    }
+}
+
+const char* targetMetricName(TargetMetric metric) {
+    switch (metric) {
+    case TargetMetric::ResidentMegabytes:
+        return "rss";
+    case TargetMetric::PartialPages:
+        return "partial";
+    case TargetMetric::FragmentationRatio:
+        return "frag";
+    case TargetMetric::HeapSpanMegabytes:
+        return "span";
+    default:
+        return "none";
+    }
+}
+
+const char* purgeModeName(PurgeMode mode) {
+    switch (mode) {
+    case PurgeMode::Purge:
+        return "purge";
+    case PurgeMode::Retain:
+        return "retain";
+    case PurgeMode::Decay:
+        return "decay";
+    default:
+        return "none";
+    }
+}
+
+LitterConfig LitterConfig::fromEnvironment() {
+    LitterConfig config;
+
+    Log log;
     if (const char* env = std::getenv("LITTER_LOG_FILENAME")) {
-        log = fopen(env, "w");
+        config.logFilename = env;
+        log.open(env);
     }
 
-    std::uint32_t seed = std::random_device{}();
     if (const char* env = std::getenv("LITTER_SEED")) {
-        seed = atoi(env);
+        config.seed = atoi(env);
     }
-    std::mt19937_64 generator(seed);
 
-    double occupancy = 0.95;
     if (const char* env = std::getenv("LITTER_OCCUPANCY")) {
-        occupancy = atof(env);
-        assertOrExit(occupancy >= 0 && occupancy <= 1, log, "Occupancy must be between 0 and 1.");
+        config.occupancy = atof(env);
     }
 
-    bool shuffle = true;
     if (const char* env = std::getenv("LITTER_SHUFFLE")) {
-        shuffle = atoi(env);
+        config.freeStrategy = atoi(env) ? FreeStrategy::Random : FreeStrategy::HighestAddresses;
     }
 
-    std::uint32_t sleepDelay = 0;
     if (const char* env = std::getenv("LITTER_SLEEP")) {
-        sleepDelay = atoi(env);
+        config.sleepSeconds = atoi(env);
     }
 
-    std::uint32_t multiplier = 20;
+    config.logSystem = std::getenv("LITTER_STABILIZE") || std::getenv("LITTER_CPUS") || std::getenv("LITTER_MLOCK");
+
     if (const char* env = std::getenv("LITTER_MULTIPLIER")) {
-        multiplier = atoi(env);
+        config.multiplier = atoi(env);
+    }
+
+    if (const char* env = std::getenv("LITTER_TOUCH")) {
+        for (const auto mode : {TouchMode::None, TouchMode::First, TouchMode::CacheLine, TouchMode::Full}) {
+            if (std::strcmp(env, touchModeName(mode)) == 0) {
+                config.touch = mode;
+            }
+        }
+        assertOrExit(std::strcmp(env, touchModeName(config.touch)) == 0, log,
+                     "LITTER_TOUCH must be one of none, first, line or full.");
+    }
+
+    if (const char* env = std::getenv("LITTER_PREFAULT")) {
+        config.prefault = atoi(env);
+    }
+
+    if (const char* env = std::getenv("LITTER_PREFAULT_THREADS")) {
+        config.prefaultThreads = atoi(env);
+    }
+
+    if (const char* env = std::getenv("LITTER_PRODUCERS")) {
+        config.producers = atoi(env);
+        config.consumers = config.producers;
+    }
+    if (const char* env = std::getenv("LITTER_CONSUMERS")) {
+        config.consumers = atoi(env);
+        assertOrExit(config.producers > 0, log, "LITTER_CONSUMERS requires LITTER_PRODUCERS.");
+    }
+    if (const char* env = std::getenv("LITTER_REMOTE_FRACTION")) {
+        config.remoteFraction = atof(env);
+    }
+
+    if (const char* env = std::getenv("LITTER_PAGE_SIZE")) {
+        config.pageSize = parsePageSize(env);
+        assertOrExit(config.pageSize != 0, log, "LITTER_PAGE_SIZE must be 4k, 2m, system, or a power of two.");
+    }
+
+    if (const char* env = std::getenv("LITTER_PIN_PAGES")) {
+        if (atoi(env)) {
+            config.freeStrategy = FreeStrategy::PinPages;
+        }
+    }
+
+    if (const char* env = std::getenv("LITTER_REALLOC")) {
+        config.reallocChains = atoi(env);
+    }
+
+    if (const char* env = std::getenv("LITTER_TARGET")) {
+        assertOrExit(parseMetric(env, config.target.metric, config.target.value) && config.target.value > 0, log,
+                     "LITTER_TARGET must be rss:<MB>, partial:<fraction>, frag:<ratio> or span:<MB>.");
+    }
+
+    if (const char* env = std::getenv("LITTER_GENERATIONS")) {
+        config.generations.maxGenerations = atoi(env);
+    }
+    if (const char* env = std::getenv("LITTER_CHURN")) {
+        config.generations.churn = atof(env);
+    }
+    if (const char* env = std::getenv("LITTER_CONVERGENCE")) {
+        assertOrExit(parseMetric(env, config.generations.metric, config.generations.tolerance), log,
+                     "LITTER_CONVERGENCE must be rss:<tolerance>, frag:<tolerance> or span:<tolerance>.");
+    }
+
+    if (const char* env = std::getenv("LITTER_API_MIX")) {
+        config.apiMix = atoi(env);
+    }
+
+    if (const char* env = std::getenv("LITTER_PURGE")) {
+        for (const auto mode : {PurgeMode::None, PurgeMode::Purge, PurgeMode::Retain, PurgeMode::Decay}) {
+            if (std::strcmp(env, purgeModeName(mode)) == 0) {
+                config.purge = mode;
+            }
+        }
+        if (std::strncmp(env, "decay:", 6) == 0) {
+            config.purge = PurgeMode::Decay;
+            config.decaySeconds = atoi(env + 6);
+        }
+        assertOrExit(config.purge != PurgeMode::None || std::strcmp(env, "none") == 0, log,
+                     "LITTER_PURGE must be one of none, purge, retain, decay or decay:<seconds>.");
+    }
+
+    if (const char* env = std::getenv("LITTER_PHASE")) {
+        config.phase = env;
     }
 
-    std::string dataFilename = "detector.out";
     if (const char* env = std::getenv("LITTER_DATA_FILENAME")) {
-        dataFilename = env;
+        config.profile = env;
+    }
+
+    return config;
+}
+
+// Everything a Litter keeps between run() and release(). It is placed in its own arena, so that destroying it unmaps
+// all of the bookkeeping at once.
+struct Litter::State {
+    explicit State(Arena&& arena) : arena(std::move(arena)) {}
+
+    Arena arena;
+    ObjectTable* objects = nullptr;
+    // Objects from this index on are the surviving litter.
+    std::size_t firstSurvivor = 0;
+    // Usable sizes of the first nFreedSizes objects, with LitterConfig::keepFreedSizes.
+    std::size_t* freedSizes = nullptr;
+    std::size_t nFreedSizes = 0;
+};
+
+Litter::Litter(const LitterConfig& config) : configuration(config) {}
+
+Litter::~Litter() {
+    release();
+}
+
+void Litter::release() {
+    if (state && state->objects) {
+        freeObjects(*state->objects, state->firstSurvivor, state->objects->size());
+        stats.freed += stats.retained;
+        stats.retained = 0;
+    }
+    leak();
+}
+
+std::size_t Litter::freedObjects(void** addresses, std::size_t* sizes, std::size_t capacity) const {
+    if (!state || !state->objects) {
+        return 0;
+    }
+    for (std::size_t i = 0; i < std::min(capacity, state->firstSurvivor); ++i) {
+        addresses[i] = (*state->objects)[i];
+        if (sizes) {
+            sizes[i] = i < state->nFreedSizes ? state->freedSizes[i] : 0;
+        }
+    }
+    return state->firstSurvivor;
+}
+
+void Litter::leak() {
+    if (state) {
+        Arena arena = std::move(state->arena);
+        state->~State();
+        state = nullptr;
     }
+}
+
+void Litter::run() {
+    release();
+
+    const LitterConfig& config = configuration;
+    stats = {};
+
+    Arena stateArena;
+    state = new (stateArena.allocate<State>(1)) State(std::move(stateArena));
+    Arena& arena = state->arena;
+
+    Log log;
+    if (config.logFilename) {
+        log.open(config.logFilename);
+    }
+
+    assertOrExit(config.occupancy >= 0 && config.occupancy <= 1, log, "Occupancy must be between 0 and 1.");
+    assertOrExit(config.remoteFraction >= 0 && config.remoteFraction <= 1, log,
+                 "Remote fraction must be between 0 and 1.");
+    assertOrExit(!config.producers || config.consumers, log, "Cross-thread littering needs at least one consumer.");
+    assertOrExit(config.freeStrategy != FreeStrategy::PinPages || !config.producers, log,
+                 "LITTER_PIN_PAGES cannot be combined with LITTER_PRODUCERS.");
+    assertOrExit(!config.reallocChains || !config.producers, log,
+                 "LITTER_REALLOC cannot be combined with LITTER_PRODUCERS.");
+    assertOrExit(!config.apiMix || !config.producers, log, "LITTER_API_MIX cannot be combined with LITTER_PRODUCERS.");
+    assertOrExit(config.target.metric == TargetMetric::None
+                     || (!config.producers && config.freeStrategy == FreeStrategy::Random),
+                 log, "LITTER_TARGET cannot be combined with LITTER_PRODUCERS, LITTER_SHUFFLE=0 or LITTER_PIN_PAGES.");
+    assertOrExit(config.generations.churn > 0 && config.generations.churn <= 1, log,
+                 "Churn must be between 0 and 1.");
+    assertOrExit(config.generations.metric != TargetMetric::PartialPages, log,
+                 "Generations cannot converge on partial pages.");
+    for (const auto metric : {config.target.metric, config.generations.metric}) {
+        assertOrExit(metric != TargetMetric::ResidentMegabytes || residentBytes() != 0, log,
+                     "The resident set size is not available on this platform.");
+    }
+
+    const std::size_t pageSize = config.pageSize ? config.pageSize : systemPageSize();
+    assertOrExit((pageSize & (pageSize - 1)) == 0, log, "The page size must be a power of two.");
+    const unsigned prefaultThreads
+        = config.prefaultThreads ? config.prefaultThreads : std::max(1u, std::thread::hardware_concurrency());
 
-    assertOrExit(std::filesystem::exists(dataFilename), log, dataFilename + " does not exist.");
+    const std::uint32_t seed = config.seed ? *config.seed : std::random_device{}();
+    stats.seed = seed;
+    std::mt19937_64 generator(seed);
+
+    ArenaVector<ProfileComponent> components(arena);
+    assertOrExit(parseProfileList(config.profile, arena, components), log,
+                 "The profile list must be <filename>[:<weight>],..., with positive weights.");
+    assertOrExit(components.size() == 1 || (!config.reallocChains && !config.apiMix), log,
+                 "LITTER_REALLOC and LITTER_API_MIX need a single profile.");
+
+    for (auto& component : components) {
+        component.data = parseJsonFile(component.filename, arena);
+        assertOrExit(component.data != nullptr, log, "%s does not exist or is not valid JSON.", component.filename);
+        const JsonValue& data = *component.data;
+        assertOrExit(data["Bins"].isArray() && data["NAllocations"].isNumber()
+                         && data["MaxLiveAllocations"].isNumber(),
+                     log, "%s is not a detector profile.", component.filename);
 
-    std::ifstream inputFile(dataFilename);
-    nlohmann::json data;
-    inputFile >> data;
+        // Sizes and the number of live objects come from the chosen phase, realloc chains from the whole run.
+        component.profile = config.phase ? findPhase(data, config.phase) : &data;
+        assertOrExit(component.profile != nullptr, log, "%s has no phase %s.", component.filename, config.phase);
+        const JsonValue& profile = *component.profile;
+        assertOrExit(profile["Bins"].isArray() && profile["NAllocations"].integer > 0, log,
+                     "Phase %s of %s has no allocations.", config.phase, component.filename);
+    }
+    const JsonValue& data = *components.front().data;
 
 #if _WIN32
     HMODULE mallocModule;
@@ -109,80 +1537,470 @@ void runLitterer() {
                              (LPCSTR) &malloc, &mallocModule);
     assertOrExit(status, log, "Could not get malloc info.");
 
-    char mallocFileName[MAX_PATH];
+    // Static, since the statistics point to it.
+    static char mallocFileName[MAX_PATH];
     GetModuleFileNameA(mallocModule, mallocFileName, MAX_PATH);
-    const std::string mallocSourceObject = mallocFileName;
+    const char* mallocSourceObject = mallocFileName;
 #else
     Dl_info mallocInfo;
-    const auto status = dladdr((void*) &malloc, &mallocInfo);
+    const auto status = dladdr(mallocAddress(), &mallocInfo);
     assertOrExit(status != 0, log, "Could not get malloc info.");
-    const std::string mallocSourceObject = mallocInfo.dli_fname;
+    const char* mallocSourceObject = mallocInfo.dli_fname;
+#endif
+
+    const Allocator allocator;
+    assertOrExit((config.target.metric != TargetMetric::FragmentationRatio
+                  && (!config.generations.maxGenerations
+                      || config.generations.metric != TargetMetric::FragmentationRatio))
+                     || allocator.reportsFragmentation(),
+                 log, "Measuring fragmentation needs an allocator reporting its statistics (jemalloc or glibc).");
+
+    const ArenaVector<std::uint64_t> bins = mixtureBins(arena, components);
+    double weightedMaxLive = 0;
+    for (const auto& component : components) {
+        weightedMaxLive += component.weight * (*component.profile)["MaxLiveAllocations"].integer;
+    }
+    const auto maxLiveAllocations = std::max(1ll, std::llround(weightedMaxLive));
+    const std::size_t nAllocationsLitter = maxLiveAllocations * config.multiplier;
+
+    log.print("==================================== Litterer ====================================\n");
+    log.print("malloc     : %s\n", mallocSourceObject);
+    stats.mallocObject = mallocSourceObject;
+    stats.allocator = allocator.source();
+    log.print("seed       : %u\n", seed);
+    log.print("occupancy  : %f\n", config.occupancy);
+    log.print("shuffle    : %s\n", config.freeStrategy != FreeStrategy::HighestAddresses ? "yes" : "no");
+    if (config.sleepSeconds) {
+        log.print("sleep      : %u\n", config.sleepSeconds);
+    } else {
+        log.print("sleep      : no\n");
+    }
+    log.print("litter     : %u * %lld = %zu\n", config.multiplier, static_cast<long long>(maxLiveAllocations),
+              nAllocationsLitter);
+    log.print("timestamp  : %s %s\n", __DATE__, __TIME__);
+    // Settings beyond the original ones come after them, and only when they are not the default, so that scripts
+    // reading the header of runs with the default settings keep working.
+    if (components.size() > 1 || config.phase) {
+        for (const auto& component : components) {
+            const JsonValue& profile = *component.profile;
+            log.print("profile    : %s * %g (%lld live)\n", component.filename, component.weight,
+                      static_cast<long long>(profile["MaxLiveAllocations"].integer));
+            if (config.phase) {
+                const auto name = profile["Name"].string;
+                log.print("phase      : %.*s (%lld allocation(s) from allocation %lld)\n",
+                          static_cast<int>(name.size()), name.data(),
+                          static_cast<long long>(profile["NAllocations"].integer),
+                          static_cast<long long>(profile["Start"].integer));
+            }
+        }
+    }
+    if (config.touch != TouchMode::None) {
+        log.print("touch      : %s\n", touchModeName(config.touch));
+    }
+    if (config.prefault) {
+        log.print("prefault   : yes\n");
+    }
+    if (config.pageSize) {
+        log.print("page size  : %zu\n", pageSize);
+    }
+    if (config.freeStrategy == FreeStrategy::PinPages) {
+        log.print("pin pages  : yes\n");
+    }
+    if (config.reallocChains) {
+        log.print("realloc    : yes\n");
+    }
+    if (config.apiMix) {
+        log.print("api mix    : yes\n");
+    }
+    if (config.purge != PurgeMode::None) {
+        log.print("purge      : %s (%s)\n", purgeModeName(config.purge),
+                  allocator.source() ? allocator.source() : "unknown allocator");
+    }
+    if (config.target.metric != TargetMetric::None) {
+        const bool fromAllocator = config.target.metric == TargetMetric::FragmentationRatio;
+        log.print("target     : %s >= %g%s%s\n", targetMetricName(config.target.metric), config.target.value,
+                  fromAllocator ? ", reported by " : "", fromAllocator ? allocator.source() : "");
+    }
+    if (config.generations.maxGenerations) {
+        log.print("generations: up to %u, %.0f%% churn, until %s changes by less than %g%%\n",
+                  config.generations.maxGenerations, config.generations.churn * 100,
+                  targetMetricName(config.generations.metric), config.generations.tolerance * 100);
+    }
+    if (config.producers) {
+        log.print("threads    : %u producer(s), %u consumer(s), %.0f%% remote frees\n", config.producers,
+                  config.consumers, config.remoteFraction * 100);
+    }
+#if __linux__
+    if (config.logSystem) {
+        logSystem(log);
+    }
 #endif
+    log.print("==================================================================================\n");
 
-    const auto bins = data["Bins"].get<std::vector<std::uint64_t>>();
-    const auto nAllocations = data["NAllocations"].get<std::uint64_t>();
-    const auto maxLiveAllocations = data["MaxLiveAllocations"].get<std::int64_t>();
-    const std::size_t nAllocationsLitter = maxLiveAllocations * multiplier;
+    const ArenaVector<std::uint64_t> binsCumSum = cumulative_sum(bins);
 
-    fprintf(log, "==================================== Litterer ====================================\n");
-    fprintf(log, "malloc     : %s\n", mallocSourceObject.c_str());
-    fprintf(log, "seed       : %u\n", seed);
-    fprintf(log, "occupancy  : %f\n", occupancy);
-    fprintf(log, "shuffle    : %s\n", shuffle ? "yes" : "no");
-    fprintf(log, "sleep      : %s\n", sleepDelay ? std::to_string(sleepDelay).c_str() : "no");
-    fprintf(log, "litter     : %u * %zu = %zu\n", multiplier, maxLiveAllocations, nAllocationsLitter);
-    fprintf(log, "timestamp  : %s %s\n", __DATE__, __TIME__);
-    fprintf(log, "==================================================================================\n");
+    SizeSampler sampler(binsCumSum, binsCumSum.back());
+    ReallocChainSampler chains(arena, data);
+    ApiSampler apis(data);
+    assertOrExit(!config.apiMix || apis.available(), log, "%s has no allocation API mix.", config.profile);
+    assertOrExit(!config.reallocChains || chains.available(), log, "%s has no realloc chains.", config.profile);
 
-    assert(std::accumulate(bins.begin(), bins.end(), 0zu) == nAllocations);
-    const std::vector<std::uint64_t> binsCumSum = cumulative_sum(bins);
+    // Both probes replay the same chains.
+    constexpr std::size_t nProbeChains = 10000;
+    const std::uint64_t probeSeed = seed ^ 0x5bd1e995;
+    if (config.reallocChains) {
+        std::mt19937_64 probeGenerator(probeSeed);
+        stats.cleanReallocMoveRate = reallocMoveRate(arena, chains, nProbeChains, probeGenerator);
+    }
 
     const auto litterStart = std::chrono::high_resolution_clock::now();
+    const auto litterStartFaults = pageFaults();
+    StepTimes times(stats);
 
-    std::uniform_int_distribution<std::uint64_t> distribution(1, nAllocations);
-    std::vector<void*> objects = *(new std::vector<void*>);
-    objects.reserve(nAllocationsLitter);
+    state->objects = new (arena.allocate<ObjectTable>(1)) ObjectTable(arena, nAllocationsLitter);
+    ObjectTable& objects = *state->objects;
+    std::size_t nObjectsToBeFreed = static_cast<std::size_t>((1 - config.occupancy) * nAllocationsLitter);
+    std::size_t& firstSurvivor = state->firstSurvivor;
 
-    for (std::size_t i = 0; i < nAllocationsLitter; ++i) {
-        const auto offset = distribution(generator);
-        const auto it = std::lower_bound(binsCumSum.begin(), binsCumSum.end(), offset);
-        assert(it != binsCumSum.end());
-        const auto bin = std::distance(binsCumSum.begin(), it) + 1;
-        void* pointer = MALLOC(bin);
-        objects.push_back(pointer);
+    ReallocCounts reallocCounts;
+    std::uniform_real_distribution<double> startsChain(0, 1);
+    ApiCounts apiCounts;
+    // Addresses of the aligned litter, for the alignment waste estimate. Recording stops once it is full.
+    ArenaVector<std::uintptr_t> alignedObjects(arena);
+    if (config.apiMix) {
+        alignedObjects.reserve(nAllocationsLitter);
     }
 
-    const std::size_t nObjectsToBeFreed = static_cast<std::size_t>((1 - occupancy) * nAllocationsLitter);
+    // Allocates and touches one litter object of a drawn size.
+    const auto allocateSized = [&](std::size_t size) {
+        void* pointer;
+        if (config.apiMix) {
+            bool aligned;
+            pointer = apis(generator, size, apiCounts, aligned);
+            if (aligned && alignedObjects.size() < alignedObjects.capacity()) {
+                alignedObjects.push_back(reinterpret_cast<std::uintptr_t>(pointer));
+            }
+        } else {
+            pointer = MALLOC(size);
+        }
+        touch(pointer, size, config.touch);
+        return pointer;
+    };
+
+    // Allocates and touches one litter object, from a replayed realloc chain or straight from the size histogram.
+    const auto allocate = [&](std::size_t& size) {
+        if (config.reallocChains && startsChain(generator) < chains.chainFraction()) {
+            void* pointer = chains(generator, size, reallocCounts);
+            touch(pointer, size, config.touch);
+            return pointer;
+        }
+        size = sampler(generator);
+        return allocateSized(size);
+    };
 
-    if (shuffle) {
-        fprintf(log, "Shuffling %zu object(s) to be freed.\n", nObjectsToBeFreed);
-        partial_shuffle(objects, nObjectsToBeFreed, generator);
+    PageOccupancy* pages = nullptr;
+    const auto measure = [&](TargetMetric metric) -> double {
+        switch (metric) {
+        case TargetMetric::ResidentMegabytes:
+            // Leave out the litterer's own bookkeeping, which is resident too.
+            return static_cast<double>(residentBytes() - (arena.used() - objects.unusedBytes())) / (1 << 20);
+        case TargetMetric::PartialPages:
+            return pages->partialFraction();
+        case TargetMetric::HeapSpanMegabytes: {
+            auto low = std::numeric_limits<std::uintptr_t>::max();
+            std::uintptr_t high = 0;
+            for (std::size_t i = firstSurvivor; i < objects.size(); ++i) {
+                low = std::min(low, reinterpret_cast<std::uintptr_t>(objects[i]));
+                high = std::max(high, reinterpret_cast<std::uintptr_t>(objects[i]));
+            }
+            return high > low ? static_cast<double>(high - low) / (1 << 20) : 0;
+        }
+        default:
+            return allocator.fragmentation();
+        }
+    };
+
+    if (config.producers) {
+        const auto result
+            = litterAcrossThreads(arena, objects, sampler, nAllocationsLitter, nObjectsToBeFreed, config, seed);
+        log.print("Freed %zu object(s) from consumer threads and %zu from their producers.\n", result.remoteFrees,
+                  result.localFrees);
+        stats.remoteFrees = result.remoteFrees;
+        stats.freed = result.remoteFrees + result.localFrees;
+        times.lap("threads");
+    } else if (config.target.metric != TargetMetric::None) {
+        if (config.target.metric == TargetMetric::PartialPages) {
+            pages = new (arena.allocate<PageOccupancy>(1)) PageOccupancy(arena, nAllocationsLitter, pageSize);
+        }
+
+        const auto allocateObject = [&]() {
+            std::size_t size;
+            void* pointer = allocate(size);
+            if (pages) {
+                pages->allocated(pointer);
+            }
+            return pointer;
+        };
+        const auto freeObject = [&](void* pointer) {
+            if (pages) {
+                pages->freed(pointer);
+            }
+            FREE(pointer);
+        };
+
+        const auto result = litterToTarget(objects, firstSurvivor, nAllocationsLitter, maxLiveAllocations,
+                                           config.occupancy, config.target.value,
+                                           [&] { return measure(config.target.metric); }, allocateObject, freeObject,
+                                           generator, log);
+        log.print("%s %s target of %g after %zu round(s) and %zu object(s): %g.\n",
+                  result.reached ? "Reached" : "Did not reach", targetMetricName(config.target.metric),
+                  config.target.value, result.rounds, objects.size(), result.measured);
+        stats.freed = firstSurvivor;
+        stats.rounds = result.rounds;
+        stats.targetMeasured = result.measured;
+        stats.targetReached = result.reached;
+        times.lap("rounds");
     } else {
-        // TODO: We should maybe make this a third-option.
-        std::sort(objects.begin(), objects.end(), std::greater<void*>());
+        if (config.reallocChains) {
+            for (std::size_t i = 0; i < nAllocationsLitter; ++i) {
+                std::size_t size;
+                objects.push_back(allocate(size));
+            }
+            times.lap("allocation");
+        } else {
+            SizeBatches batches(arena, sampler, seed, std::max(1u, std::thread::hardware_concurrency()));
+            while (objects.size() < nAllocationsLitter) {
+                const auto sizes = batches.next(nAllocationsLitter - objects.size());
+                times.lap("sampling");
+                for (const auto size : sizes) {
+                    objects.push_back(allocateSized(size));
+                }
+                times.lap("allocation");
+            }
+        }
+
+        if (config.touch != TouchMode::None) {
+            const auto allocationEnd = std::chrono::high_resolution_clock::now();
+            log.print("Allocated and touched %zu object(s) in %lld ms (%lld page faults).\n", nAllocationsLitter,
+                      static_cast<long long>(
+                          std::chrono::duration_cast<std::chrono::milliseconds>(allocationEnd - litterStart).count()),
+                      static_cast<long long>(pageFaults() - litterStartFaults));
+        }
+
+        switch (config.freeStrategy) {
+        case FreeStrategy::PinPages: {
+            const auto nPinned = pinPages(objects, pageSize, generator);
+            const auto nFree = std::min(nObjectsToBeFreed, objects.size() - nPinned);
+            log.print("Pinned %zu page(s) of %zu KB, shuffling %zu object(s) to be freed.\n", nPinned,
+                      pageSize >> 10, nFree);
+            objects.visit([&](auto handles) {
+                partial_shuffle(handles.first(handles.size() - nPinned), nFree, generator);
+            });
+            nObjectsToBeFreed = nFree;
+            stats.pinnedPages = nPinned;
+            times.lap("pinning");
+            break;
+        }
+        case FreeStrategy::Random:
+            log.print("Shuffling %zu object(s) to be freed.\n", nObjectsToBeFreed);
+            objects.visit([&](auto handles) { partial_shuffle(handles, nObjectsToBeFreed, generator); });
+            times.lap("shuffling");
+            break;
+        case FreeStrategy::HighestAddresses:
+            // Only the objects to be freed need to be in order, highest first.
+            if (nObjectsToBeFreed) {
+                objects.visit([&](auto handles) {
+                    std::nth_element(handles.begin(), handles.begin() + (nObjectsToBeFreed - 1), handles.end(),
+                                     std::greater<>());
+                });
+                objects.sortByAddress(0, nObjectsToBeFreed, true);
+            }
+            times.lap("sorting");
+            break;
+        }
+
+        if (config.keepFreedSizes && allocator.reportsUsableSizes() && nObjectsToBeFreed) {
+            state->freedSizes = arena.allocate<std::size_t>(nObjectsToBeFreed);
+            for (std::size_t i = 0; i < nObjectsToBeFreed; ++i) {
+                state->freedSizes[i] = allocator.usableSize(objects[i]);
+            }
+            state->nFreedSizes = nObjectsToBeFreed;
+            times.lap("sizing");
+        }
+        freeObjects(objects, 0, nObjectsToBeFreed);
+        times.lap("freeing");
+        firstSurvivor = nObjectsToBeFreed;
+        stats.freed = nObjectsToBeFreed;
+    }
+
+    if (config.reallocChains) {
+        log.print("Replayed %zu realloc chain(s): %zu realloc(s), %.1f%% moved.\n", reallocCounts.chains,
+                  reallocCounts.reallocs,
+                  reallocCounts.reallocs ? 100.0 * reallocCounts.moved / reallocCounts.reallocs : 0.0);
+        stats.reallocs = reallocCounts.reallocs;
+        stats.reallocsMoved = reallocCounts.moved;
     }
 
-    for (std::size_t i = 0; i < nObjectsToBeFreed; ++i) {
-        FREE(objects[i]);
+    if (config.generations.maxGenerations) {
+        // Pinned objects stay out of the churn, so that their pages stay pinned.
+        const auto result = churnGenerations(objects, firstSurvivor, objects.size() - stats.pinnedPages,
+                                             config.generations, config.freeStrategy,
+                                             [&] { return measure(config.generations.metric); },
+                                             [&] {
+                                                 std::size_t size;
+                                                 return allocate(size);
+                                             },
+                                             generator, log);
+        log.print("%s after %zu generation(s) of %.0f%% churn: %s = %g.\n",
+                  result.converged ? "Converged" : "Did not converge", result.generations,
+                  config.generations.churn * 100, targetMetricName(config.generations.metric), result.measured);
+        stats.generations = result.generations;
+        stats.generationMeasured = result.measured;
+        stats.converged = result.converged;
+        times.lap("generations");
     }
 
     const auto litterEnd = std::chrono::high_resolution_clock::now();
-    const auto elapsed = std::chrono::duration_cast<std::chrono::seconds>((litterEnd - litterStart));
-    fprintf(log, "Finished littering. Time taken: %s seconds.\n", std::to_string(elapsed.count()).c_str());
+    char breakdown[256];
+    times.format(breakdown, sizeof(breakdown));
+    log.print("Finished littering in %.1f ms (%s).\n", times.totalMilliseconds(), breakdown);
+    log.print("Bookkeeping: %zu MB mapped outside of the heap, %s object handles.\n", arena.mapped() >> 20,
+              objects.compact() ? "32-bit" : "64-bit");
+
+    if (config.apiMix) {
+        log.print("API mix: %zu %s, %zu %s, %zu %s, %zu %s.\n", apiCounts.calls[0], ApiSampler::names[0],
+                  apiCounts.calls[1], ApiSampler::names[1], apiCounts.calls[2], ApiSampler::names[2],
+                  apiCounts.calls[3], ApiSampler::names[3]);
+        stats.alignedAllocations
+            = apiCounts.calls[ApiSampler::PosixMemalign] + apiCounts.calls[ApiSampler::AlignedAlloc];
+
+        if (allocator.reportsUsableSizes()) {
+            std::sort(alignedObjects.begin(), alignedObjects.end());
+            const auto waste = alignmentWaste(objects, firstSurvivor, alignedObjects, allocator);
+            log.print("Alignment waste: ~%zu KB before %zu live aligned object(s) (mean gap %.1f bytes, %.1f before "
+                      "others).\n",
+                      waste.bytes >> 10, waste.nAligned, waste.alignedGap, waste.otherGap);
+            stats.alignmentWasteBytes = waste.bytes;
+        } else {
+            log.print("Alignment waste: unavailable, the allocator does not export malloc_usable_size.\n");
+        }
+    }
+
+    if (config.reallocChains) {
+        std::mt19937_64 probeGenerator(probeSeed);
+        stats.litteredReallocMoveRate = reallocMoveRate(arena, chains, nProbeChains, probeGenerator);
+        const auto profiled = data["NReallocs"].integer;
+        log.print("Realloc moves over %zu chain(s): %.1f%% after littering, %.1f%% on a clean heap, %.1f%% in the "
+                  "profile.\n",
+                  nProbeChains, stats.litteredReallocMoveRate * 100, stats.cleanReallocMoveRate * 100,
+                  profiled ? 100.0 * data["NReallocsMoved"].integer / profiled : 0.0);
+    }
+
+    stats.allocated = nAllocationsLitter;
+    stats.retained = objects.size() - firstSurvivor;
+    stats.milliseconds = std::chrono::duration<double, std::milli>(litterEnd - litterStart).count();
+    stats.pageFaults = pageFaults() - litterStartFaults;
+
+    if (config.prefault) {
+        const auto prefaultStart = std::chrono::high_resolution_clock::now();
+        const auto prefaultStartFaults = pageFaults();
+
+        // Coalesce the pages spanned by each surviving object into ranges, in address order.
+        objects.sortByAddress(firstSurvivor, objects.size());
+        const std::size_t systemPage = systemPageSize();
+        ArenaVector<PageRange> ranges(arena);
+        ranges.reserve(objects.size() - firstSurvivor);
+        for (std::size_t i = firstSurvivor; i < objects.size(); ++i) {
+            const auto address = reinterpret_cast<std::uintptr_t>(objects[i]);
+            const auto size = std::max<std::size_t>(allocator.usableSize(objects[i]), 1);
+            const auto page = address & ~(systemPage - 1);
+            const auto end = (address + size + systemPage - 1) & ~(systemPage - 1);
+            if (!ranges.empty() && page <= ranges.back().end) {
+                ranges.back().end = std::max(ranges.back().end, end);
+            } else {
+                ranges.push_back({page, end});
+            }
+        }
 
-    if (sleepDelay) {
+        const auto result = prefault(ranges, prefaultThreads);
+        if (!result.supported) {
+            // Without MADV_POPULATE_WRITE, fall back to writing to every line of every surviving object.
+            for (std::size_t i = firstSurvivor; i < objects.size(); ++i) {
+                touch(objects[i], allocator.usableSize(objects[i]), TouchMode::CacheLine);
+            }
+        }
+
+        const auto prefaultEnd = std::chrono::high_resolution_clock::now();
+        log.print("Prefaulted %zu MB in %zu range(s) %s in %lld ms (%lld page faults).\n", result.bytes >> 20,
+                  ranges.size(),
+                  result.supported ? "with MADV_POPULATE_WRITE" : "by touching (MADV_POPULATE_WRITE unavailable)",
+                  static_cast<long long>(
+                      std::chrono::duration_cast<std::chrono::milliseconds>(prefaultEnd - prefaultStart).count()),
+                  static_cast<long long>(pageFaults() - prefaultStartFaults));
+        if (result.supported) {
+            log.print("Prefault used %u thread(s).\n", result.threads);
+        }
+    }
+
+    if (firstSurvivor < objects.size()) {
+        auto heapStart = std::numeric_limits<std::uintptr_t>::max();
+        std::uintptr_t heapEnd = 0;
+        for (std::size_t i = firstSurvivor; i < objects.size(); ++i) {
+            const auto address = reinterpret_cast<std::uintptr_t>(objects[i]);
+            heapStart = std::min(heapStart, address);
+            heapEnd = std::max(heapEnd, address + std::max<std::size_t>(allocator.usableSize(objects[i]), 1));
+        }
+
+        const auto usage = hugePageUsage(heapStart, heapEnd);
+        if (usage.available) {
+            log.print("Huge pages: %zu of %zu MB resident in the littered heap (%.1f%%), %zu MB in the process.\n",
+                      usage.anonHugePages >> 20, usage.rss >> 20,
+                      usage.rss ? 100.0 * usage.anonHugePages / usage.rss : 0.0, usage.totalAnonHugePages >> 20);
+        }
+    }
+
+    if (config.purge != PurgeMode::None) {
+        const auto residentBefore = residentBytes();
+        const char* call = nullptr;
+        switch (config.purge) {
+        case PurgeMode::Purge:
+            call = allocator.purge();
+            break;
+        case PurgeMode::Retain:
+            call = allocator.retain();
+            break;
+        default:
+            log.print("Waiting %u seconds for the allocator to decay...\n", config.decaySeconds);
+            std::this_thread::sleep_for(std::chrono::seconds(config.decaySeconds));
+            call = allocator.decay();
+            break;
+        }
+
+        const auto residentAfter = residentBytes();
+        stats.purgedBytes = static_cast<std::int64_t>(residentBefore) - static_cast<std::int64_t>(residentAfter);
+        if (call || config.purge == PurgeMode::Decay) {
+            log.print("Post-litter %s with %s: %lld KB returned to the OS (RSS %zu MB -> %zu MB).\n",
+                      purgeModeName(config.purge), call ? call : "no call",
+                      static_cast<long long>(stats.purgedBytes / 1024), residentBefore >> 20, residentAfter >> 20);
+        } else {
+            log.print("Post-litter %s is not supported by %s.\n", purgeModeName(config.purge),
+                      allocator.source() ? allocator.source() : "this allocator");
+        }
+    }
+
+    stats.bookkeepingBytes = arena.mapped();
+
+    if (config.sleepSeconds) {
 #ifdef _WIN32
         const auto pid = GetCurrentProcessId();
 #else
         const auto pid = getpid();
 #endif
-        fprintf(log, "Sleeping %u seconds before resuming (PID: %d)...\n", sleepDelay, pid);
-        std::this_thread::sleep_for(std::chrono::seconds(sleepDelay));
-        fprintf(log, "Resuming program now!\n");
+        log.print("Sleeping %u seconds before resuming (PID: %d)...\n", config.sleepSeconds, pid);
+        std::this_thread::sleep_for(std::chrono::seconds(config.sleepSeconds));
+        log.print("Resuming program now!\n");
     }
 
-    fprintf(log, "==================================================================================\n");
-    if (log != stderr) {
-        fclose(log);
-    }
+    log.print("==================================================================================\n");
 }
+} // namespace litterer
@@ -0,0 +1,166 @@
+#include "locality-probe.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "allocation-trigger.h"
+#include "overlap.h"
+
+namespace {
+constexpr std::size_t windowSize = 1000;
+constexpr std::size_t cacheLineSize = 64;
+
+std::uint64_t nToRecord = 0;
+std::uintptr_t* recorded = nullptr;
+std::size_t* recordedSizes = nullptr;
+AddressRange* holes = nullptr;
+std::size_t nHoles = 0;
+// Whether the litterer knew the sizes of its holes, which the bytes reusing them need.
+bool holeSizesKnown = false;
+bool started = false;
+
+[[noreturn]] void exitWithError(const char* message) {
+    fprintf(stderr, "[ERROR] %s\n", message);
+    exit(EXIT_FAILURE);
+}
+
+template <typename T>
+T* mapArray(std::size_t n) {
+    void* memory = mmap(nullptr, std::max<std::size_t>(n, 1) * sizeof(T), PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (memory == MAP_FAILED) {
+        exitWithError("LITTER_LOCALITY: could not map the probe's buffers.");
+    }
+    return static_cast<T*>(memory);
+}
+
+// Distinct values of `shift`-aligned blocks among sorted addresses.
+std::size_t distinctBlocks(const std::uintptr_t* sorted, std::size_t n, unsigned shift) {
+    std::size_t distinct = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        distinct += i == 0 || (sorted[i] >> shift) != (sorted[i - 1] >> shift);
+    }
+    return distinct;
+}
+} // namespace
+
+void configureLocalityProbe() {
+    const char* env = std::getenv("LITTER_LOCALITY");
+    if (!env) {
+        return;
+    }
+    nToRecord = std::strtoull(env, nullptr, 10);
+    if (!nToRecord) {
+        exitWithError("LITTER_LOCALITY must be a positive number of allocations.");
+    }
+    if (!recordAllocations || !recordedAllocations) {
+        exitWithError("LITTER_LOCALITY needs liblitterer-trigger.so, which hooks malloc.");
+    }
+}
+
+bool localityProbeConfigured() {
+    return nToRecord != 0;
+}
+
+void startLocalityProbe(const litterer::Litter& litter) {
+    if (!nToRecord || started) {
+        return;
+    }
+    started = true;
+
+    nHoles = litter.freedObjects(nullptr, nullptr, 0);
+    auto* addresses = mapArray<void*>(nHoles);
+    auto* sizes = mapArray<std::size_t>(nHoles);
+    litter.freedObjects(addresses, sizes, nHoles);
+    holes = mapArray<AddressRange>(nHoles);
+    for (std::size_t i = 0; i < nHoles; ++i) {
+        holes[i] = {reinterpret_cast<std::uintptr_t>(addresses[i]), sizes[i]};
+        holeSizesKnown |= sizes[i] != 0;
+    }
+    munmap(addresses, std::max<std::size_t>(nHoles, 1) * sizeof(void*));
+    munmap(sizes, std::max<std::size_t>(nHoles, 1) * sizeof(std::size_t));
+
+    recorded = mapArray<std::uintptr_t>(nToRecord);
+    recordedSizes = mapArray<std::size_t>(nToRecord);
+    recordAllocations(recorded, recordedSizes, nToRecord);
+}
+
+void reportLocalityProbe() {
+    if (!started) {
+        return;
+    }
+    const std::size_t n = recordedAllocations();
+    const std::size_t pageSize = sysconf(_SC_PAGESIZE);
+    const unsigned pageShift = std::countr_zero(pageSize);
+    const unsigned lineShift = std::countr_zero(cacheLineSize);
+
+    // Distances between consecutive allocations in the order they were made, in power-of-two buckets up to a page.
+    const unsigned nBuckets = pageShift + 2;
+    std::size_t buckets[64] = {};
+    double sumDistances = 0;
+    for (std::size_t i = 1; i < n; ++i) {
+        const auto distance
+            = recorded[i] > recorded[i - 1] ? recorded[i] - recorded[i - 1] : recorded[i - 1] - recorded[i];
+        sumDistances += std::min<std::uintptr_t>(distance, pageSize);
+        ++buckets[std::min<unsigned>(std::bit_width(distance), nBuckets - 1)];
+    }
+
+    // The recorded addresses stay in allocation order for the windows below.
+    auto* allocations = mapArray<AddressRange>(n);
+    std::size_t allocatedBytes = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        allocations[i] = {recorded[i], recordedSizes[i]};
+        allocatedBytes += recordedSizes[i];
+    }
+    const auto reuse = overlap(holes, nHoles, allocations, n);
+    munmap(allocations, std::max<std::size_t>(n, 1) * sizeof(AddressRange));
+
+    // Footprint of every full window of consecutive allocations.
+    std::size_t nWindows = 0;
+    double pages = 0;
+    double lines = 0;
+    for (std::size_t start = 0; start + windowSize <= n; start += windowSize, ++nWindows) {
+        std::uintptr_t window[windowSize];
+        std::copy(recorded + start, recorded + start + windowSize, window);
+        std::sort(window, window + windowSize);
+        pages += distinctBlocks(window, windowSize, pageShift);
+        lines += distinctBlocks(window, windowSize, lineShift);
+    }
+
+    fprintf(stderr, "==================================== Locality ====================================\n");
+    fprintf(stderr, "Recorded %zu allocation(s) after littering.\n", n);
+    if (n > 1) {
+        fprintf(stderr, "Avg distance between consecutive allocations: %.1f bytes (clamped at %zu).\n",
+                sumDistances / (n - 1), pageSize);
+        for (unsigned bucket = 0; bucket < nBuckets; ++bucket) {
+            if (!buckets[bucket]) {
+                continue;
+            }
+            const double fraction = 100.0 * buckets[bucket] / (n - 1);
+            if (bucket == 0) {
+                fprintf(stderr, "\t0: %zu (%.1f%%)\n", buckets[bucket], fraction);
+            } else if (bucket == nBuckets - 1) {
+                fprintf(stderr, "\t>= %zu: %zu (%.1f%%)\n", pageSize, buckets[bucket], fraction);
+            } else {
+                fprintf(stderr, "\t< %zu: %zu (%.1f%%)\n", std::size_t{1} << bucket, buckets[bucket], fraction);
+            }
+        }
+    }
+    if (nWindows) {
+        fprintf(stderr, "Per %zu allocations: %.1f distinct page(s), %.1f distinct cache line(s).\n", windowSize,
+                pages / nWindows, lines / nWindows);
+    }
+    fprintf(stderr, "Reused litter holes: %zu of %zu allocation(s) (%.1f%%), out of %zu hole(s).\n", reuse.objects, n,
+            n ? 100.0 * reuse.objects / n : 0.0, nHoles);
+    if (holeSizesKnown) {
+        fprintf(stderr, "Bytes in litter holes: %zu KB of %zu KB allocated (%.1f%%).\n", reuse.bytes >> 10,
+                allocatedBytes >> 10, allocatedBytes ? 100.0 * reuse.bytes / allocatedBytes : 0.0);
+    }
+    fprintf(stderr, "==================================================================================\n");
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <litterer/litterer.h>
+
+// Measures the spatial locality of the program's own allocations after littering (LITTER_LOCALITY=<n>): the addresses
+// returned by its next n malloc calls are recorded through liblitterer-trigger.so's malloc hook, and the report at exit
+// gives the distances between consecutive allocations, the distinct pages and cache lines touched per 1000
+// allocations, and how many allocations, and how many of their bytes, reused a hole freed by the litterer. All of the
+// probe's memory is privately mapped, so the heap only holds the program's objects and the litter.
+
+// Reads LITTER_LOCALITY, exiting if it is set without the malloc hook.
+void configureLocalityProbe();
+
+// Whether LITTER_LOCALITY is set, in which case litter passes should keep the sizes of the objects they free.
+bool localityProbeConfigured();
+
+// Called after a litter pass, before its litter is leaked: keeps the addresses of the freed litter and starts
+// recording. Only the first pass starts the probe.
+void startLocalityProbe(const litterer::Litter& litter);
+
+// Prints the report to stderr, if the probe was started.
+void reportLocalityProbe();
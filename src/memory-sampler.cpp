@@ -0,0 +1,176 @@
+#include "memory-sampler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "allocator.h"
+#include "counters.h"
+#include "pages.h"
+
+namespace {
+struct Sample {
+    std::uint64_t milliseconds;
+    std::uint64_t rssKb;
+    std::uint64_t anonKb;
+    std::uint64_t anonHugeKb;
+    std::uint64_t minorFaults;
+    std::int64_t activeBytes;
+};
+
+// A day at 100 ms.
+constexpr std::size_t maxSamples = 1 << 20;
+
+Sample* samples = nullptr;
+std::size_t nSamples = 0;
+std::size_t nDropped = 0;
+unsigned intervalMs = 0;
+const char* filename = "memory.csv";
+timespec start;
+pthread_t thread;
+std::atomic_bool stopping{false};
+bool started = false;
+
+[[noreturn]] void exitWithError(const char* message) {
+    fprintf(stderr, "[ERROR] %s\n", message);
+    exit(EXIT_FAILURE);
+}
+
+// The value in KB of a "Name:   123 kB" line.
+std::uint64_t field(const char* text, const char* name) {
+    const char* line = std::strstr(text, name);
+    return line ? std::strtoull(line + std::strlen(name), nullptr, 10) : 0;
+}
+
+std::uint64_t millisecondsSinceStart() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1'000'000;
+}
+
+void takeSample(const Allocator& allocator) {
+    if (nSamples == maxSamples) {
+        ++nDropped;
+        return;
+    }
+    Sample& sample = samples[nSamples];
+    sample.milliseconds = millisecondsSinceStart();
+
+    char buffer[4096];
+    if (readSmallFile("/proc/self/status", buffer, sizeof(buffer))) {
+        sample.rssKb = field(buffer, "VmRSS:");
+        sample.anonKb = field(buffer, "RssAnon:");
+    }
+    // A walk of the page tables, which is why the interval should not be too short on large heaps.
+    if (readSmallFile("/proc/self/smaps_rollup", buffer, sizeof(buffer))) {
+        sample.anonHugeKb = field(buffer, "AnonHugePages:");
+    }
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    sample.minorFaults = usage.ru_minflt;
+    sample.activeBytes = allocator.activeBytes();
+    ++nSamples;
+}
+
+// Samples at a fixed rate: sleeping until absolute deadlines keeps the sampling time from adding up.
+void* sampleMemory(void*) {
+    const Allocator allocator;
+    timespec deadline = start;
+    while (!stopping.load()) {
+        takeSample(allocator);
+        recordHelperUsage(Helper::MemorySampler);
+        deadline.tv_nsec += static_cast<long>(intervalMs % 1000) * 1'000'000;
+        deadline.tv_sec += intervalMs / 1000 + deadline.tv_nsec / 1'000'000'000;
+        deadline.tv_nsec %= 1'000'000'000;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR) {
+        }
+    }
+    return nullptr;
+}
+} // namespace
+
+void startMemorySampler() {
+    const char* env = std::getenv("LITTER_MEMORY_INTERVAL");
+    if (!env) {
+        return;
+    }
+    intervalMs = atoi(env);
+    if (!intervalMs) {
+        exitWithError("LITTER_MEMORY_INTERVAL must be a positive number of milliseconds.");
+    }
+    if (const char* name = std::getenv("LITTER_MEMORY_FILENAME")) {
+        filename = name;
+    }
+
+    void* memory = mmap(nullptr, maxSamples * sizeof(Sample), PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (memory == MAP_FAILED) {
+        exitWithError("LITTER_MEMORY_INTERVAL: could not map the sample buffer.");
+    }
+    samples = static_cast<Sample*>(memory);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    // Created with pthreads, since std::thread would allocate.
+    if (pthread_create(&thread, nullptr, sampleMemory, nullptr) != 0) {
+        exitWithError("LITTER_MEMORY_INTERVAL: could not create the sampler thread.");
+    }
+    started = true;
+}
+
+MemorySummary memorySummary() {
+    MemorySummary summary = {nSamples, 0, 0, nSamples ? -1 : 0};
+    for (std::size_t i = 0; i < nSamples; ++i) {
+        summary.peakRssKb = std::max(summary.peakRssKb, samples[i].rssKb);
+        summary.peakAnonHugeKb = std::max(summary.peakAnonHugeKb, samples[i].anonHugeKb);
+        summary.peakActiveBytes = std::max(summary.peakActiveBytes, samples[i].activeBytes);
+    }
+    return summary;
+}
+
+void writeMemorySamples() {
+    if (!started) {
+        return;
+    }
+    stopping.store(true);
+    pthread_join(thread, nullptr);
+    // One last sample at exit.
+    takeSample(Allocator());
+
+    const int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "[WARNING] Could not write the memory samples to %s (%s).\n", filename, std::strerror(errno));
+        return;
+    }
+    char line[256];
+    const auto writeLine = [&](int length) {
+        if (length > 0) {
+            [[maybe_unused]] const auto written = write(fd, line, static_cast<std::size_t>(length));
+        }
+    };
+    writeLine(
+        std::snprintf(line, sizeof(line), "ms,rss_kb,anon_kb,anon_huge_kb,minor_faults,allocator_active_bytes\n"));
+    for (std::size_t i = 0; i < nSamples; ++i) {
+        const Sample& sample = samples[i];
+        writeLine(std::snprintf(line, sizeof(line), "%llu,%llu,%llu,%llu,%llu,%lld\n",
+                                static_cast<unsigned long long>(sample.milliseconds),
+                                static_cast<unsigned long long>(sample.rssKb),
+                                static_cast<unsigned long long>(sample.anonKb),
+                                static_cast<unsigned long long>(sample.anonHugeKb),
+                                static_cast<unsigned long long>(sample.minorFaults),
+                                static_cast<long long>(sample.activeBytes)));
+    }
+    close(fd);
+    fprintf(stderr, "Memory: %zu sample(s) every %u ms written to %s%s.\n", nSamples, intervalMs, filename,
+            nDropped ? " (buffer full, later samples dropped)" : "");
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Records the program's memory over time (LITTER_MEMORY_INTERVAL=<ms>), from after littering to exit, on a thread of
+// its own: the resident set, its anonymous part, anonymous huge pages, minor page faults, and the bytes the allocator
+// reports active. Samples go to a buffer mapped up front and are written as CSV to LITTER_MEMORY_FILENAME (default:
+// memory.csv) at exit, so sampling neither allocates nor writes files while the program runs.
+
+// Reads the environment and starts the sampler thread; exits on invalid values.
+void startMemorySampler();
+
+// Stops the sampler thread and writes the samples, if it was started.
+void writeMemorySamples();
+
+struct MemorySummary {
+    std::size_t nSamples;
+    std::uint64_t peakRssKb;
+    std::uint64_t peakAnonHugeKb;
+    // -1 if the allocator does not report its active bytes.
+    std::int64_t peakActiveBytes;
+};
+
+// Peaks over the samples taken so far; all zero if the sampler was not started.
+MemorySummary memorySummary();
@@ -1,5 +1,4 @@
 #include <algorithm>
-#include <array>
 #include <chrono>
 #include <cstdlib>
 #include <cstring>
@@ -7,7 +6,6 @@
 #include <map>
 #include <random>
 #include <thread>
-#include <unordered_set>
 #include <vector>
 
 #include <assert.h>
@@ -34,12 +32,8 @@ extern "C" void _putchar(char ch) { ::write(1, (void *)&ch, 1); }
 #endif
 
 #include "printf.h"
-
-#define PAGE_SIZE 4096
-
-#ifndef OBJECT_DISTANCE
-#define OBJECT_DISTANCE PAGE_SIZE
-#endif
+#include "overlap.h"
+#include "pages.h"
 
 template <typename T>
 std::ostream& operator<<(std::ostream& o, const std::vector<T>& v) {
@@ -56,7 +50,7 @@ std::ostream& operator<<(std::ostream& o, const std::vector<T>& v) {
 
 namespace {
 std::size_t guess(std::size_t objectSize, std::size_t nObjectsAlreadyAllocated, std::size_t nPagesFilled,
-                  std::size_t nPages, std::size_t pageSize = PAGE_SIZE) {
+                  std::size_t nPages, std::size_t pageSize = smallPageSize) {
     return (nObjectsAlreadyAllocated && nPagesFilled) ? nObjectsAlreadyAllocated * nPages / nPagesFilled
                                                       : nPages * pageSize / objectSize;
 }
@@ -79,18 +73,19 @@ T abs(T x) {
 #define ITERATIONS 100'000
 #endif
 
-#define MAX_OBJECTS (N * PAGE_SIZE / OBJECT_SIZE + 1)
+// Sized for 4 KiB pages: littering at a larger page size stops once the arrays are full.
+#define MAX_OBJECTS (N * smallPageSize / OBJECT_SIZE + 1)
 
-int litter(std::array<void*, MAX_OBJECTS>& toBeFreed,
+int litter(MappedArray<void*>& toBeFreed,
 	    std::size_t objectSize,
 	    std::size_t nPages,
 	    std::default_random_engine::result_type seed = std::random_device()(),
-	    std::size_t pageSize = PAGE_SIZE)
+	    std::size_t pageSize = smallPageSize)
 {
   printf_("Littering begins.\n");
   
     auto nAllocations = guess(objectSize, 0, 0, nPages, pageSize);
-    std::array<void*, MAX_OBJECTS> allocated;
+    MappedArray<void*> allocated(MAX_OBJECTS);
     int nAllocated = 0;
     int nFreed = 0;
     std::size_t PagesFilled = 0;
@@ -119,6 +114,10 @@ int litter(std::array<void*, MAX_OBJECTS>& toBeFreed,
         if (PagesFilled >= nPages) {
             break;
         }
+        if (nAllocated == MAX_OBJECTS) {
+          printf_("Littering: out of space after filling %d of %d pages.\n", (int) PagesFilled, (int) nPages);
+          break;
+        }
 
         nAllocations = guess(objectSize, nAllocations, PagesFilled, nPages, pageSize);
     }
@@ -143,8 +142,6 @@ int litter(std::array<void*, MAX_OBJECTS>& toBeFreed,
     return nFreed;
 }
 
-const auto distanceClampMax = PAGE_SIZE;
-
 int main([[maybe_unused]] int argc, [[maybe_unused]] char** argv)
 {
     std::uint32_t sleepDelay = 0;
@@ -152,11 +149,27 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char** argv)
         sleepDelay = atoi(env);
     }
 
+    // Page granularity (LITTER_PAGE_SIZE: 4k, 2m, system or bytes) used for the distance clamp, and for littering
+    // unless OBJECT_DISTANCE is set at compile time.
+    const std::size_t pageSize = pageSizeFromEnvironment();
+    if (!pageSize) {
+        std::cerr << "LITTER_PAGE_SIZE must be 4k, 2m, system, or a power of two." << std::endl;
+        return EXIT_FAILURE;
+    }
+#ifdef OBJECT_DISTANCE
+    const std::size_t objectDistance = OBJECT_DISTANCE;
+#else
+    const std::size_t objectDistance = pageSize;
+#endif
+    const auto distanceClampMax = pageSize;
+
     std::cout << "Object size: " << OBJECT_SIZE << std::endl;
-    std::cout << "Object distance: " << OBJECT_DISTANCE << std::endl;
+    std::cout << "Object distance: " << objectDistance << std::endl;
+    std::cout << "Page size: " << pageSize << std::endl;
 
-    std::array<void *, MAX_OBJECTS> freed;
-    auto nFreed = litter(freed, OBJECT_SIZE, N, std::random_device()(), OBJECT_DISTANCE);
+    // Mapped rather than on the stack or the heap being measured.
+    MappedArray<void *> freed(MAX_OBJECTS);
+    auto nFreed = litter(freed, OBJECT_SIZE, N, std::random_device()(), objectDistance);
 
     if (sleepDelay) {
 #ifdef _WIN32
@@ -169,8 +182,7 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char** argv)
         std::cout << "Resuming program now!" << std::endl;
     }
 
-    std::array<void*, N> objects;
-    //    objects.reserve(N);
+    MappedArray<void*> objects(N);
 
     printf_("allocating %d objects\n", N);
     for (std::size_t i = 0; i < N; ++i) {
@@ -182,6 +194,13 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char** argv)
 
     std::sort(objects.begin(), objects.end());
 
+    const auto usage = hugePageUsage(reinterpret_cast<std::uintptr_t>(objects[0]),
+                                     reinterpret_cast<std::uintptr_t>(objects[N - 1]) + OBJECT_SIZE);
+    if (usage.available) {
+      printf_("AnonHugePages: %d of %d KB resident in the heap, %d KB in the process\n",
+              (int) (usage.anonHugePages >> 10), (int) (usage.rss >> 10), (int) (usage.totalAnonHugePages >> 10));
+    }
+
     std::size_t sumDistances = 0;
     auto distances = std::map<std::size_t, std::size_t>();
     for (std::size_t i = 1; i < objects.size(); ++i) {
@@ -194,38 +213,20 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char** argv)
     }
 
 
-    int intersection = 0;
-    int intersectionBytes = 0;
-    {
-      std::unordered_set<void *> freedBytes;
-      {
-	std::unordered_set<void *> freedSet;
-	for (auto i = 0; i < nFreed; i++) {
-	  freedSet.insert(freed[i]);
-	}
-	for (const auto& f : freedSet) {
-	  assert(f);
-	  for (auto i = 0; i < OBJECT_SIZE; i++) {
-	    freedBytes.insert((void *) ((uintptr_t) f + i));
-	  }
-	}
-	intersection
-	  = std::count_if(objects.begin(), objects.end(), [&](const auto o) { return freedSet.contains(o); });
-      }
-      
-      {
-	std::unordered_set<void *> objectsBytes;
-	for (const auto& o : objects) {
-	  for (auto i = 0; i < OBJECT_SIZE; i++) {
-	    objectsBytes.insert((void *) ((uintptr_t) o + i));
-	  }
-	}
-	
-	intersectionBytes
-	  = std::count_if(objectsBytes.begin(), objectsBytes.end(), [&](const auto o) { return freedBytes.contains(o); });
-      }
+    // Overlap of the new objects with the freed litter, from a sort and sweep over address ranges.
+    MappedArray<AddressRange> freedRanges(nFreed);
+    for (auto i = 0; i < nFreed; i++) {
+      assert(freed[i]);
+      freedRanges[i] = {reinterpret_cast<std::uintptr_t>(freed[i]), OBJECT_SIZE};
     }
-    
+    MappedArray<AddressRange> objectRanges(objects.size());
+    for (std::size_t i = 0; i < objects.size(); i++) {
+      objectRanges[i] = {reinterpret_cast<std::uintptr_t>(objects[i]), OBJECT_SIZE};
+    }
+    const auto reuse = overlap(freedRanges.data(), freedRanges.size(), objectRanges.data(), objectRanges.size());
+    const auto intersection = reuse.objects;
+    const auto intersectionBytes = reuse.bytes;
+
     std::cout << "Intersection (objects): " << intersection << " / " << (objects.size()) << std::endl;
     auto ratioBytes = (float) intersectionBytes / (float) (OBJECT_SIZE * objects.size());
     std::cout << "Intersection (bytes): " << intersectionBytes << " / " << (OBJECT_SIZE * objects.size()) << " (" << ratioBytes << ")" << std::endl;
@@ -260,8 +261,8 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char** argv)
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
     printf_("Elapsed (littered): %d ms\n", duration);
 
-    std::array<void*, N> newObjects;
-    volatile char buf[N * OBJECT_SIZE];
+    MappedArray<void*> newObjects(N);
+    MappedArray<char> buf(N * OBJECT_SIZE);
     for (auto i = 0; i < N; i++) {
       newObjects[i] = (void *) &buf[i * OBJECT_SIZE]; // std::malloc(OBJECT_SIZE);
     }
@@ -1,4 +1,6 @@
 #include <algorithm>
+#include <atomic>
+#include <barrier>
 #include <chrono>
 #include <cstdlib>
 #include <cstring>
@@ -6,8 +8,6 @@
 #include <map>
 #include <random>
 #include <thread>
-#include <unordered_set>
-#include <vector>
 
 #if _WIN32
 #ifndef NOMINMAX
@@ -16,57 +16,349 @@
 #include <windows.h>
 #endif
 
-#define PAGE_SIZE 4096
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "overlap.h"
+#include "pages.h"
+#include "threads.h"
 
-#ifndef OBJECT_DISTANCE
-#define OBJECT_DISTANCE PAGE_SIZE
+#ifndef N
+#define N 10'000 // Number of pages.
 #endif
 
-template <typename T>
-std::ostream& operator<<(std::ostream& o, const std::vector<T>& v) {
-    if (v.empty()) {
-        return o << "[]";
-    }
+#ifndef OBJECT_SIZE
+#define OBJECT_SIZE 32 // Size of objects.
+#endif
 
-    o << "[" << v[0];
-    for (std::size_t i = 1; i < v.size(); ++i) {
-        o << ", " << v[i];
-    }
-    return o << "]";
-}
+#ifndef ITERATIONS
+#define ITERATIONS 40'000
+#endif
 
 namespace {
 std::size_t guess(std::size_t objectSize, std::size_t nObjectsAlreadyAllocated, std::size_t nPagesFilled,
-                  std::size_t nPages, std::size_t pageSize = PAGE_SIZE) {
+                  std::size_t nPages, std::size_t pageSize = smallPageSize) {
     return (nObjectsAlreadyAllocated && nPagesFilled) ? nObjectsAlreadyAllocated * nPages / nPagesFilled
                                                       : nPages * pageSize / objectSize;
 }
 
-template <typename T>
-T abs(T x) {
-    return x < 0 ? -x : x;
+// Values of one parameter of the sweep.
+struct Grid {
+    static constexpr std::size_t maxValues = 32;
+    std::size_t values[maxValues];
+    std::size_t n = 0;
+};
+
+// Parses a comma-separated list of positive numbers, each optionally followed by k, m or g (binary multiples), e.g.
+// "16,32,4k". Returns false if it is not one.
+bool parseGrid(const char* text, Grid& grid) {
+    grid.n = 0;
+    while (*text) {
+        char* end = nullptr;
+        std::size_t value = std::strtoull(text, &end, 10);
+        if (end == text || grid.n == Grid::maxValues) {
+            return false;
+        }
+        switch (*end) {
+        case 'k':
+            value <<= 10;
+            ++end;
+            break;
+        case 'm':
+            value <<= 20;
+            ++end;
+            break;
+        case 'g':
+            value <<= 30;
+            ++end;
+            break;
+        default:
+            break;
+        }
+        if (!value || (*end && *end != ',')) {
+            return false;
+        }
+        grid.values[grid.n++] = value;
+        text = *end ? end + 1 : end;
+    }
+    return grid.n > 0;
 }
-} // namespace
 
-std::unordered_set<void*> litter(std::size_t objectSize, std::size_t nPages,
-                                 std::default_random_engine::result_type seed = std::random_device()(),
-                                 std::size_t pageSize = PAGE_SIZE) {
-    std::vector<void*> allocated;
+// Reads a grid from the environment, or falls back to a single value.
+bool gridFromEnvironment(const char* name, std::size_t fallback, Grid& grid) {
+    if (const char* env = std::getenv(name)) {
+        if (!parseGrid(env, grid)) {
+            std::cerr << name << " must be a comma-separated list of positive numbers (with an optional k, m or g)."
+                      << std::endl;
+            return false;
+        }
+        return true;
+    }
+    grid.values[0] = fallback;
+    grid.n = 1;
+    return true;
+}
+
+// Sums every byte of an object, 8 at a time, so that the loads cannot be optimized away.
+inline std::uint64_t readObject(const void* object, std::size_t size) {
+    const auto* bytes = static_cast<const unsigned char*>(object);
+    std::uint64_t sum = 0;
+    std::size_t i = 0;
+    for (; i + sizeof(std::uint64_t) <= size; i += sizeof(std::uint64_t)) {
+        std::uint64_t word;
+        std::memcpy(&word, bytes + i, sizeof(word));
+        sum += word;
+    }
+    for (; i < size; ++i) {
+        sum += bytes[i];
+    }
+    return sum;
+}
+
+using Kernel = std::uint64_t (*)(void* const* objects, std::size_t n, std::size_t size, std::size_t iterations);
+
+// The generic kernel, for any object size.
+std::uint64_t readObjects(void* const* objects, std::size_t n, std::size_t size, std::size_t iterations) {
+    std::uint64_t sum = 0;
+    for (std::size_t iteration = 0; iteration < iterations; ++iteration) {
+        for (std::size_t i = 0; i < n; ++i) {
+            sum += readObject(objects[i], size);
+        }
+    }
+    return sum;
+}
+
+// The same with the size known at compile time, which unrolls the reads the way a fixed OBJECT_SIZE build did.
+template <std::size_t Size>
+std::uint64_t readObjectsOfSize(void* const* objects, std::size_t n, std::size_t, std::size_t iterations) {
+    std::uint64_t sum = 0;
+    for (std::size_t iteration = 0; iteration < iterations; ++iteration) {
+        for (std::size_t i = 0; i < n; ++i) {
+            sum += readObject(objects[i], Size);
+        }
+    }
+    return sum;
+}
+
+Kernel kernelFor(std::size_t size) {
+    switch (size) {
+    case 8:
+        return readObjectsOfSize<8>;
+    case 16:
+        return readObjectsOfSize<16>;
+    case 32:
+        return readObjectsOfSize<32>;
+    case 48:
+        return readObjectsOfSize<48>;
+    case 64:
+        return readObjectsOfSize<64>;
+    case 128:
+        return readObjectsOfSize<128>;
+    case 256:
+        return readObjectsOfSize<256>;
+    case 512:
+        return readObjectsOfSize<512>;
+    case 1024:
+        return readObjectsOfSize<1024>;
+    default:
+        return readObjects;
+    }
+}
 
+// Links the objects into a circular list in `order`, through the first word of each object.
+void threadList(void* const* order, std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i) {
+        std::memcpy(order[i], &order[i + 1 < n ? i + 1 : 0], sizeof(void*));
+    }
+}
+
+// Follows the list threadList made, one dependent load per object, as code walking a linked list built in allocation
+// order does.
+std::uint64_t chaseObjects(void* const* order, std::size_t n, std::size_t, std::size_t iterations) {
+    std::uint64_t sum = 0;
+    for (std::size_t iteration = 0; iteration < iterations; ++iteration) {
+        void* object = order[0];
+        for (std::size_t i = 0; i < n; ++i) {
+            sum += reinterpret_cast<std::uintptr_t>(object);
+            std::memcpy(&object, object, sizeof(void*));
+        }
+    }
+    return sum;
+}
+
+// Increments every word of each object, so that each line is read and written back.
+std::uint64_t updateObjects(void* const* order, std::size_t n, std::size_t size, std::size_t iterations) {
+    for (std::size_t iteration = 0; iteration < iterations; ++iteration) {
+        for (std::size_t i = 0; i < n; ++i) {
+            auto* bytes = static_cast<unsigned char*>(order[i]);
+            std::size_t j = 0;
+            for (; j + sizeof(std::uint64_t) <= size; j += sizeof(std::uint64_t)) {
+                std::uint64_t word;
+                std::memcpy(&word, bytes + j, sizeof(word));
+                ++word;
+                std::memcpy(bytes + j, &word, sizeof(word));
+            }
+            for (; j < size; ++j) {
+                ++bytes[j];
+            }
+        }
+    }
+    return readObject(order[0], size);
+}
+
+// Streams through the pointers and gathers the first word of each object, four at a time with AVX2 where the CPU has
+// it, as vectorized code over an array of pointers does.
+std::uint64_t gatherObjects(void* const* order, std::size_t n, std::size_t, std::size_t iterations) {
+    std::uint64_t sum = 0;
+    for (std::size_t iteration = 0; iteration < iterations; ++iteration) {
+        for (std::size_t i = 0; i < n; ++i) {
+            std::uint64_t word;
+            std::memcpy(&word, order[i], sizeof(word));
+            sum += word;
+        }
+    }
+    return sum;
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+__attribute__((target("avx2"))) std::uint64_t gatherObjectsAvx2(void* const* order, std::size_t n, std::size_t,
+                                                                 std::size_t iterations) {
+    __m256i sums = _mm256_setzero_si256();
+    std::uint64_t sum = 0;
+    for (std::size_t iteration = 0; iteration < iterations; ++iteration) {
+        std::size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            const __m256i addresses = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(order + i));
+            sums = _mm256_add_epi64(sums, _mm256_i64gather_epi64(static_cast<const long long*>(nullptr), addresses, 1));
+        }
+        for (; i < n; ++i) {
+            std::uint64_t word;
+            std::memcpy(&word, order[i], sizeof(word));
+            sum += word;
+        }
+    }
+    std::uint64_t lanes[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), sums);
+    return sum + lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+#endif
+
+bool hasAvx2() {
+#if defined(__GNUC__) && defined(__x86_64__)
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+// The access patterns timed on every layout. Each runs over one of the layout's orders of the objects.
+enum class Order { Address, Allocation, Random };
+enum class Access { Read, Chase, Update, Gather };
+
+struct AccessKernel {
+    const char* name;
+    Order order;
+    Access access;
+};
+
+constexpr AccessKernel accessKernels[] = {
+    {"sorted", Order::Address, Access::Read},
+    {"allocation", Order::Allocation, Access::Read},
+    {"random", Order::Random, Access::Read},
+    {"chase", Order::Allocation, Access::Chase},
+    {"rmw", Order::Allocation, Access::Update},
+    {"gather", Order::Allocation, Access::Gather},
+};
+constexpr std::size_t nAccessKernels = sizeof(accessKernels) / sizeof(accessKernels[0]);
+
+// Chasing and gathering load a whole word from each object.
+std::size_t minimumSize(Access access) {
+    return access == Access::Chase || access == Access::Gather ? sizeof(std::uint64_t) : 1;
+}
+
+Kernel kernelFor(Access access, std::size_t size) {
+    switch (access) {
+    case Access::Chase:
+        return chaseObjects;
+    case Access::Update:
+        return updateObjects;
+    case Access::Gather:
+#if defined(__GNUC__) && defined(__x86_64__)
+        if (hasAvx2()) {
+            return gatherObjectsAvx2;
+        }
+#endif
+        return gatherObjects;
+    default:
+        return kernelFor(size);
+    }
+}
+
+// The same objects in address order, in the order they were allocated, and in a random order.
+struct Layout {
+    void* const* orders[3];
+    std::size_t n;
+    std::size_t size;
+};
+
+// Whether the kernel runs on the layout: chasing and gathering need objects of a word, and threads sharing a set of
+// objects only read it, since the list links and the updates would race.
+bool runs(Access access, std::size_t size, bool shared) {
+    return size >= minimumSize(access) && !(shared && (access == Access::Chase || access == Access::Update));
+}
+
+// Nanoseconds per object of every kernel on the layout; negative where it does not run. `wait(k)` is called before and
+// after each kernel that runs, e.g. to keep threads in lockstep.
+template <typename Wait>
+void timeKernels(const Layout& layout, std::size_t iterations, bool shared, double (&nsPerObject)[nAccessKernels],
+                 Wait&& wait) {
+    for (std::size_t k = 0; k < nAccessKernels; ++k) {
+        if (!runs(accessKernels[k].access, layout.size, shared)) {
+            nsPerObject[k] = -1;
+            continue;
+        }
+        const auto kernel = kernelFor(accessKernels[k].access, layout.size);
+        void* const* order = layout.orders[static_cast<int>(accessKernels[k].order)];
+        if (accessKernels[k].access == Access::Chase) {
+            threadList(order, layout.n);
+        }
+        wait(k);
+        const auto start = std::chrono::high_resolution_clock::now();
+        volatile std::uint64_t count = kernel(order, layout.n, layout.size, iterations);
+        const auto end = std::chrono::high_resolution_clock::now();
+        (void) count;
+        wait(k);
+        nsPerObject[k] = (double) std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()
+                       / ((double) iterations * layout.n);
+    }
+}
+
+// Allocates objects until they fill `nPages` pages, then frees the first object of every page in a random order. The
+// objects left, in [0, nSurvivors) of `allocated`, are what the caller frees once done; the freed ones go to `freed`.
+// All of this storage is mapped, so that the heap only holds the objects.
+void litter(MappedArray<void*>& allocated, std::size_t& nSurvivors, MappedArray<AddressRange>& freed,
+            std::size_t& nFreed, std::size_t objectSize, std::size_t nPages,
+            std::default_random_engine::result_type seed = std::random_device()(),
+            std::size_t pageSize = smallPageSize, bool quiet = false) {
     auto nAllocations = guess(objectSize, 0, 0, nPages, pageSize);
+    std::size_t nAllocated = 0;
     std::size_t PagesFilled = 0;
 
     for (;;) {
-        std::cout << "Allocating " << nAllocations << " objects..." << std::endl;
-        while (allocated.size() < nAllocations) {
-            allocated.push_back(std::malloc(objectSize));
+        nAllocations = std::clamp<std::size_t>(nAllocations, 2, allocated.size());
+        if (!quiet) {
+            std::cout << "Allocating " << nAllocations << " objects..." << std::endl;
+        }
+        while (nAllocated < nAllocations) {
+            allocated[nAllocated++] = std::malloc(objectSize);
         }
 
         // Recount how many pages our current allocations are filling.
-        std::sort(allocated.begin(), allocated.end());
+        std::sort(allocated.begin(), allocated.begin() + nAllocated);
         PagesFilled = 0;
         std::uintptr_t previous = (std::uintptr_t) allocated[0];
-        for (std::size_t i = 1; i < allocated.size(); ++i) {
+        for (std::size_t i = 1; i < nAllocated; ++i) {
             if ((std::uintptr_t) allocated[i] - previous >= pageSize) {
                 previous = (std::uintptr_t) allocated[i];
                 ++PagesFilled;
@@ -77,57 +369,73 @@ std::unordered_set<void*> litter(std::size_t objectSize, std::size_t nPages,
         if (PagesFilled >= nPages) {
             break;
         }
+        if (nAllocated == allocated.size()) {
+            if (!quiet) {
+                std::cout << "Out of space after filling " << PagesFilled << " of " << nPages << " pages."
+                          << std::endl;
+            }
+            break;
+        }
 
         nAllocations = guess(objectSize, nAllocations, PagesFilled, nPages, pageSize);
     }
 
-    std::vector<void*> toBeFreed;
-    toBeFreed.reserve(PagesFilled);
-
-    auto previous = reinterpret_cast<std::uintptr_t>(allocated[0]);
-    for (std::size_t i = 1; i < allocated.size(); ++i) {
-        if (reinterpret_cast<std::uintptr_t>(allocated[i]) - previous >= pageSize) {
-            toBeFreed.push_back((void*) previous);
-            previous = reinterpret_cast<std::uintptr_t>(allocated[i]);
+    // The first object of every page is freed, the others survive.
+    nFreed = 0;
+    nSurvivors = 0;
+    void* first = allocated[0];
+    for (std::size_t i = 1; i < nAllocated; ++i) {
+        if (reinterpret_cast<std::uintptr_t>(allocated[i]) - reinterpret_cast<std::uintptr_t>(first) >= pageSize) {
+            freed[nFreed++] = {reinterpret_cast<std::uintptr_t>(first), objectSize};
+            first = allocated[i];
+        } else {
+            allocated[nSurvivors++] = allocated[i];
         }
     }
+    allocated[nSurvivors++] = first;
 
-    std::cout << "Freeing " << toBeFreed.size() << " objects..." << std::endl;
-    std::shuffle(toBeFreed.begin(), toBeFreed.end(), std::default_random_engine(seed));
-    for (auto ptr : toBeFreed) {
-        std::free(ptr);
+    if (!quiet) {
+        std::cout << "Freeing " << nFreed << " objects..." << std::endl;
     }
-
-    return std::unordered_set<void*>(toBeFreed.begin(), toBeFreed.end());
-}
-
-#ifndef N
-#define N 10'000 // Number of pages.
-#endif
-
-#ifndef OBJECT_SIZE
-#define OBJECT_SIZE 32 // Size of objects.
-#endif
-
-#ifndef ITERATIONS
-#define ITERATIONS 40'000
-#endif
-
-const auto distanceClampMax = PAGE_SIZE;
-
-int main([[maybe_unused]] int argc, [[maybe_unused]] char** argv) {
-    std::uint32_t sleepDelay = 0;
-    if (const char* env = std::getenv("LITTER_SLEEP")) {
-        sleepDelay = atoi(env);
+    std::shuffle(freed.begin(), freed.begin() + nFreed, std::default_random_engine(seed));
+    for (std::size_t i = 0; i < nFreed; ++i) {
+        std::free(reinterpret_cast<void*>(freed[i].start));
     }
+}
 
-    std::cout << "Object size: " << OBJECT_SIZE << std::endl;
-    std::cout << "Object distance: " << OBJECT_DISTANCE << std::endl;
-
-    std::vector<void*> objects;
-    objects.reserve(N);
-
-    const auto freed = litter(OBJECT_SIZE, N, std::random_device()(), OBJECT_DISTANCE);
+struct Point {
+    std::size_t objectSize;
+    std::size_t objectDistance;
+    // Per thread.
+    std::size_t nPages;
+    std::size_t iterations;
+    unsigned threads;
+    bool shared;
+    double reused;
+    // Mean nanoseconds per object of a thread, for each kernel; negative where the kernel did not run.
+    double littered[nAccessKernels];
+    double contiguous[nAccessKernels];
+    // Millions of objects per second over all threads.
+    double litteredRate[nAccessKernels];
+    double contiguousRate[nAccessKernels];
+};
+
+// Litters, allocates the objects, reports their layout, and times every access kernel on them and on the same objects
+// laid out contiguously. Frees everything before returning, so that the next point starts from the allocator's free
+// memory rather than from this point's litter.
+Point run(std::size_t objectSize, std::size_t objectDistance, std::size_t nPages, std::size_t iterations,
+          std::size_t distanceClampMax, std::uint32_t sleepDelay) {
+    std::cout << "Object size: " << objectSize << std::endl;
+    std::cout << "Object distance: " << objectDistance << std::endl;
+    std::cout << "Pages: " << nPages << std::endl;
+    std::cout << "Iterations: " << iterations << std::endl;
+
+    // Twice the objects it takes to fill the pages when the allocator packs them, the most litter() allocates.
+    MappedArray<void*> litterObjects(2 * (nPages * objectDistance / objectSize + 1));
+    MappedArray<AddressRange> freed(litterObjects.size());
+    std::size_t nSurvivors = 0;
+    std::size_t nFreed = 0;
+    litter(litterObjects, nSurvivors, freed, nFreed, objectSize, nPages, std::random_device()(), objectDistance);
 
     if (sleepDelay) {
 #ifdef _WIN32
@@ -140,16 +448,29 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char** argv) {
         std::cout << "Resuming program now!" << std::endl;
     }
 
-    for (std::size_t i = 0; i < N; ++i) {
-        objects.push_back(std::malloc(OBJECT_SIZE));
+    // Written like a program initializing its objects, so that reads do not all hit the zero page.
+    MappedArray<void*> allocationOrder(nPages);
+    for (std::size_t i = 0; i < nPages; ++i) {
+        allocationOrder[i] = std::malloc(objectSize);
+        std::memset(allocationOrder[i], 1, objectSize);
     }
 
+    MappedArray<void*> objects(nPages);
+    std::copy(allocationOrder.begin(), allocationOrder.end(), objects.begin());
     std::sort(objects.begin(), objects.end());
 
+    const auto usage = hugePageUsage(reinterpret_cast<std::uintptr_t>(objects[0]),
+                                     reinterpret_cast<std::uintptr_t>(objects[nPages - 1]) + objectSize);
+    if (usage.available) {
+        std::cout << "AnonHugePages: " << (usage.anonHugePages >> 10) << " of " << (usage.rss >> 10)
+                  << " KB resident in the heap (" << (usage.rss ? 100.0 * usage.anonHugePages / usage.rss : 0.0)
+                  << "%), " << (usage.totalAnonHugePages >> 10) << " KB in the process" << std::endl;
+    }
+
     auto distances = std::map<std::size_t, std::size_t>();
     std::size_t sumDistances = 0;
 
-    for (std::size_t i = 1; i < objects.size(); ++i) {
+    for (std::size_t i = 1; i < nPages; ++i) {
         const auto distance = std::clamp<std::size_t>(reinterpret_cast<std::uintptr_t>(objects[i])
                                                           - reinterpret_cast<std::uintptr_t>(objects[i - 1]),
                                                       0, distanceClampMax);
@@ -158,33 +479,336 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char** argv) {
         ++distances[distance];
     }
 
-    const auto intersection
-        = std::count_if(objects.begin(), objects.end(), [&](const auto o) { return freed.contains(o); });
+    MappedArray<AddressRange> objectRanges(nPages);
+    for (std::size_t i = 0; i < nPages; ++i) {
+        objectRanges[i] = {reinterpret_cast<std::uintptr_t>(objects[i]), objectSize};
+    }
+    const auto intersection = overlap(freed.data(), nFreed, objectRanges.data(), nPages);
 
-    std::cout << "Intersection: " << intersection << " / " << objects.size() << std::endl;
+    std::cout << "Intersection: " << intersection.objects << " / " << nPages << std::endl;
+    std::cout << "Intersection (bytes): " << intersection.bytes << " / " << objectSize * nPages << std::endl;
 
-    const auto avgDistance = (double) sumDistances / (objects.size() - 1);
+    const auto avgDistance = (double) sumDistances / (nPages - 1);
 
     std::cout << "Min distances:" << std::endl;
-    for (const auto [distance, count] : distances) {
+    for (const auto& [distance, count] : distances) {
         if (count > 20) {
             std::cout << "\t" << distance << ": " << count << std::endl;
         }
     }
     std::cout << "Avg distance: " << avgDistance << std::endl;
 
-    const auto start = std::chrono::high_resolution_clock::now();
+    const double reused = (double) intersection.objects / nPages;
+    Point point = {objectSize, objectDistance, nPages, iterations, 1, false, reused, {}, {}, {}, {}};
+    const auto noWait = [](std::size_t) {};
+
+    // Both layouts visit their objects in the same random order of allocation indices.
+    const auto seed = std::random_device()();
+    MappedArray<void*> randomOrder(nPages);
+    std::copy(allocationOrder.begin(), allocationOrder.end(), randomOrder.begin());
+    std::shuffle(randomOrder.begin(), randomOrder.end(), std::default_random_engine(seed));
+    timeKernels({{objects.data(), allocationOrder.data(), randomOrder.data()}, nPages, objectSize}, iterations, false,
+                point.littered, noWait);
+
+    // The contiguous layout is allocated in address order, so its first two orders are the same.
+    MappedArray<unsigned char> storage(nPages * objectSize);
+    std::memset(storage.data(), 1, storage.size());
+    MappedArray<void*> contiguous(nPages);
+    for (std::size_t i = 0; i < nPages; ++i) {
+        contiguous[i] = storage.data() + i * objectSize;
+    }
+    std::copy(contiguous.begin(), contiguous.end(), randomOrder.begin());
+    std::shuffle(randomOrder.begin(), randomOrder.end(), std::default_random_engine(seed));
+    timeKernels({{contiguous.data(), contiguous.data(), randomOrder.data()}, nPages, objectSize}, iterations, false,
+                point.contiguous, noWait);
+    for (std::size_t k = 0; k < nAccessKernels; ++k) {
+        point.litteredRate[k] = point.littered[k] > 0 ? 1e3 / point.littered[k] : -1;
+        point.contiguousRate[k] = point.contiguous[k] > 0 ? 1e3 / point.contiguous[k] : -1;
+    }
+
+    std::cout << "Kernel\tlittered ns/object\tcontiguous ns/object\tslowdown" << std::endl;
+    for (std::size_t k = 0; k < nAccessKernels; ++k) {
+        std::cout << accessKernels[k].name;
+        if (point.littered[k] < 0) {
+            std::cout << "\tn/a (objects smaller than " << minimumSize(accessKernels[k].access) << " bytes)"
+                      << std::endl;
+            continue;
+        }
+        std::cout << "\t" << point.littered[k] << "\t" << point.contiguous[k] << "\t"
+                  << point.littered[k] / point.contiguous[k] << std::endl;
+    }
+    if (objectSize >= minimumSize(Access::Gather)) {
+        std::cout << "gather: " << (hasAvx2() ? "AVX2" : "scalar") << " loads" << std::endl;
+    }
+
+    for (auto object : objects) {
+        std::free(object);
+    }
+    for (std::size_t i = 0; i < nSurvivors; ++i) {
+        std::free(litterObjects[i]);
+    }
+    return point;
+}
+
+// Runs `threads` threads that each litter their own pages and allocate their own objects, so each allocator arena is
+// littered separately, then time the kernels on all threads at once: on every thread's own objects, or with `shared`
+// on one set interleaving the objects of all threads, and likewise on contiguous layouts. Reports the throughput of
+// each thread and of all of them.
+Point runThreads(std::size_t objectSize, std::size_t objectDistance, std::size_t nPages, std::size_t iterations,
+                 unsigned threads, bool shared, std::uint32_t sleepDelay) {
+    std::cout << "Object size: " << objectSize << std::endl;
+    std::cout << "Object distance: " << objectDistance << std::endl;
+    std::cout << "Pages per thread: " << nPages << std::endl;
+    std::cout << "Iterations: " << iterations << std::endl;
+    std::cout << "Threads: " << threads << (shared ? " sharing an interleaved set" : "") << std::endl;
+
+    // The shared set holds object j of thread t at j * threads + t, in allocation order.
+    const std::size_t nShared = shared ? nPages * threads : 0;
+    MappedArray<void*> sharedAllocation(nShared);
+    MappedArray<void*> sharedSorted(nShared);
+    MappedArray<void*> sharedRandom(nShared);
+    MappedArray<unsigned char> sharedStorage(nShared * objectSize);
+    MappedArray<void*> sharedContiguous(nShared);
+    MappedArray<void*> sharedContiguousRandom(nShared);
+    const auto seed = std::random_device()();
+
+    MappedArray<double> litteredNs(threads * nAccessKernels);
+    MappedArray<double> contiguousNs(threads * nAccessKernels);
+    MappedArray<std::size_t> reused(threads);
+    // Wall-clock time of each kernel across all threads, from when they start it together to when the last is done.
+    std::chrono::high_resolution_clock::time_point starts[nAccessKernels];
+    double litteredWall[nAccessKernels] = {};
+    double contiguousWall[nAccessKernels] = {};
+
+    std::barrier barrier(threads);
+    runOnThreads(threads, [&](unsigned t) {
+        MappedArray<void*> litterObjects(2 * (nPages * objectDistance / objectSize + 1));
+        MappedArray<AddressRange> freed(litterObjects.size());
+        std::size_t nSurvivors = 0;
+        std::size_t nFreed = 0;
+        litter(litterObjects, nSurvivors, freed, nFreed, objectSize, nPages, seed + t, objectDistance, true);
+
+        MappedArray<void*> allocationOrder(nPages);
+        for (std::size_t i = 0; i < nPages; ++i) {
+            allocationOrder[i] = std::malloc(objectSize);
+            std::memset(allocationOrder[i], 1, objectSize);
+        }
+        MappedArray<void*> sorted(nPages);
+        std::copy(allocationOrder.begin(), allocationOrder.end(), sorted.begin());
+        std::sort(sorted.begin(), sorted.end());
+        MappedArray<AddressRange> objectRanges(nPages);
+        for (std::size_t i = 0; i < nPages; ++i) {
+            objectRanges[i] = {reinterpret_cast<std::uintptr_t>(sorted[i]), objectSize};
+            if (shared) {
+                sharedAllocation[i * threads + t] = allocationOrder[i];
+            }
+        }
+        reused[t] = overlap(freed.data(), nFreed, objectRanges.data(), nPages).objects;
+
+        barrier.arrive_and_wait();
+        if (t == 0) {
+            if (shared) {
+                std::copy(sharedAllocation.begin(), sharedAllocation.end(), sharedSorted.begin());
+                std::sort(sharedSorted.begin(), sharedSorted.end());
+                std::copy(sharedAllocation.begin(), sharedAllocation.end(), sharedRandom.begin());
+                std::shuffle(sharedRandom.begin(), sharedRandom.end(), std::default_random_engine(seed));
+
+                std::memset(sharedStorage.data(), 1, sharedStorage.size());
+                for (std::size_t i = 0; i < nShared; ++i) {
+                    sharedContiguous[i] = sharedStorage.data() + i * objectSize;
+                }
+                std::copy(sharedContiguous.begin(), sharedContiguous.end(), sharedContiguousRandom.begin());
+                std::shuffle(sharedContiguousRandom.begin(), sharedContiguousRandom.end(),
+                             std::default_random_engine(seed));
+            }
+            if (sleepDelay) {
+#ifdef _WIN32
+                const auto pid = GetCurrentProcessId();
+#else
+                const auto pid = getpid();
+#endif
+                std::cout << "Sleeping " << sleepDelay << " seconds before resuming (PID: " << pid << ")..."
+                          << std::endl;
+                std::this_thread::sleep_for(std::chrono::seconds(sleepDelay));
+                std::cout << "Resuming program now!" << std::endl;
+            }
+        }
+        barrier.arrive_and_wait();
+
+        // Thread 0 times each kernel from the barrier all threads start it at to the one they all finish it at.
+        bool started = false;
+        double* wall = litteredWall;
+        const auto wait = [&](std::size_t k) {
+            barrier.arrive_and_wait();
+            if (t == 0) {
+                const auto now = std::chrono::high_resolution_clock::now();
+                if (!started) {
+                    starts[k] = now;
+                } else {
+                    wall[k] = (double) std::chrono::duration_cast<std::chrono::nanoseconds>(now - starts[k]).count();
+                }
+            }
+            started = !started;
+        };
+
+        double ns[nAccessKernels];
+        MappedArray<void*> randomOrder(nPages);
+        std::copy(allocationOrder.begin(), allocationOrder.end(), randomOrder.begin());
+        std::shuffle(randomOrder.begin(), randomOrder.end(), std::default_random_engine(seed + t));
+        const Layout littered = shared ? Layout{{sharedSorted.data(), sharedAllocation.data(), sharedRandom.data()},
+                                                nShared,
+                                                objectSize}
+                                       : Layout{{sorted.data(), allocationOrder.data(), randomOrder.data()},
+                                                nPages,
+                                                objectSize};
+        timeKernels(littered, iterations, shared, ns, wait);
+        std::copy(ns, ns + nAccessKernels, litteredNs.data() + t * nAccessKernels);
+
+        MappedArray<unsigned char> storage(shared ? 0 : nPages * objectSize);
+        MappedArray<void*> contiguous(shared ? 0 : nPages);
+        if (!shared) {
+            std::memset(storage.data(), 1, storage.size());
+            for (std::size_t i = 0; i < nPages; ++i) {
+                contiguous[i] = storage.data() + i * objectSize;
+            }
+            std::copy(contiguous.begin(), contiguous.end(), randomOrder.begin());
+            std::shuffle(randomOrder.begin(), randomOrder.end(), std::default_random_engine(seed + t));
+        }
+        const Layout contiguousLayout
+            = shared ? Layout{{sharedContiguous.data(), sharedContiguous.data(), sharedContiguousRandom.data()},
+                              nShared,
+                              objectSize}
+                     : Layout{{contiguous.data(), contiguous.data(), randomOrder.data()}, nPages, objectSize};
+        wall = contiguousWall;
+        timeKernels(contiguousLayout, iterations, shared, ns, wait);
+        std::copy(ns, ns + nAccessKernels, contiguousNs.data() + t * nAccessKernels);
+
+        // Everyone is done reading the shared set before anything is freed.
+        barrier.arrive_and_wait();
+        for (auto object : allocationOrder) {
+            std::free(object);
+        }
+        for (std::size_t i = 0; i < nSurvivors; ++i) {
+            std::free(litterObjects[i]);
+        }
+    });
+
+    std::size_t nReused = 0;
+    for (unsigned t = 0; t < threads; ++t) {
+        nReused += reused[t];
+    }
+    std::cout << "Intersection: " << nReused << " / " << nPages * threads << std::endl;
+
+    Point point = {objectSize, objectDistance, nPages, iterations, threads, shared,
+                   (double) nReused / (nPages * threads), {}, {}, {}, {}};
+    const double objectsPerThread = (double) iterations * (shared ? nShared : nPages);
+    std::cout << "Kernel\tlittered Mobjects/s\tcontiguous Mobjects/s\tslowdown\tper thread (littered / contiguous)"
+              << std::endl;
+    for (std::size_t k = 0; k < nAccessKernels; ++k) {
+        std::cout << accessKernels[k].name;
+        if (!runs(accessKernels[k].access, objectSize, shared)) {
+            point.littered[k] = point.contiguous[k] = point.litteredRate[k] = point.contiguousRate[k] = -1;
+            std::cout << "\tn/a" << std::endl;
+            continue;
+        }
+        for (unsigned t = 0; t < threads; ++t) {
+            point.littered[k] += litteredNs[t * nAccessKernels + k] / threads;
+            point.contiguous[k] += contiguousNs[t * nAccessKernels + k] / threads;
+        }
+        point.litteredRate[k] = objectsPerThread * threads / litteredWall[k] * 1e3;
+        point.contiguousRate[k] = objectsPerThread * threads / contiguousWall[k] * 1e3;
+        std::cout << "\t" << point.litteredRate[k] << "\t" << point.contiguousRate[k] << "\t"
+                  << point.contiguousRate[k] / point.litteredRate[k] << "\t";
+        for (unsigned t = 0; t < threads; ++t) {
+            std::cout << (t ? ", " : "") << 1e3 / litteredNs[t * nAccessKernels + k] << " / "
+                      << 1e3 / contiguousNs[t * nAccessKernels + k];
+        }
+        std::cout << std::endl;
+    }
+    return point;
+}
+} // namespace
+
+int main([[maybe_unused]] int argc, [[maybe_unused]] char** argv) {
+    std::uint32_t sleepDelay = 0;
+    if (const char* env = std::getenv("LITTER_SLEEP")) {
+        sleepDelay = atoi(env);
+    }
 
-    volatile std::uint8_t count = 0;
-    for (std::size_t i = 0; i < ITERATIONS; i++) {
-        for (const auto object : objects) {
-            volatile char buffer[OBJECT_SIZE];
-            std::memcpy((void*) buffer, object, OBJECT_SIZE);
-            count += buffer[OBJECT_SIZE - 1];
+    // Page granularity (LITTER_PAGE_SIZE: 4k, 2m, system or bytes) used for the distance clamp, and for littering
+    // unless OBJECT_DISTANCE is set at compile time or MBP_OBJECT_DISTANCES at run time.
+    const std::size_t pageSize = pageSizeFromEnvironment();
+    if (!pageSize) {
+        std::cerr << "LITTER_PAGE_SIZE must be 4k, 2m, system, or a power of two." << std::endl;
+        return EXIT_FAILURE;
+    }
+#ifdef OBJECT_DISTANCE
+    const std::size_t objectDistance = OBJECT_DISTANCE;
+#else
+    const std::size_t objectDistance = pageSize;
+#endif
+    const auto distanceClampMax = pageSize;
+
+    // Every combination of the grids is a point of the sweep. The compile-time settings are the defaults.
+    Grid objectSizes;
+    Grid objectDistances;
+    Grid pages;
+    Grid iterations;
+    Grid threads;
+    if (!gridFromEnvironment("MBP_OBJECT_SIZES", OBJECT_SIZE, objectSizes)
+        || !gridFromEnvironment("MBP_OBJECT_DISTANCES", objectDistance, objectDistances)
+        || !gridFromEnvironment("MBP_PAGES", N, pages) || !gridFromEnvironment("MBP_ITERATIONS", 0, iterations)
+        || !gridFromEnvironment("MBP_THREADS", 1, threads)) {
+        return EXIT_FAILURE;
+    }
+    // With MBP_SHARED=1, threads also read one set interleaving all of their objects.
+    const char* sharedEnv = std::getenv("MBP_SHARED");
+    const bool shared = sharedEnv && atoi(sharedEnv);
+    std::cout << "Page size: " << pageSize << std::endl;
+
+    MappedArray<Point> points(objectSizes.n * objectDistances.n * pages.n * iterations.n * threads.n);
+    std::size_t nPoints = 0;
+    for (std::size_t s = 0; s < objectSizes.n; ++s) {
+        for (std::size_t d = 0; d < objectDistances.n; ++d) {
+            for (std::size_t p = 0; p < pages.n; ++p) {
+                for (std::size_t i = 0; i < iterations.n; ++i) {
+                    for (std::size_t t = 0; t < threads.n; ++t) {
+                        const auto nPages = std::max<std::size_t>(pages.values[p], 2);
+                        // Unless set, read as many objects at every point as ITERATIONS passes over N objects do.
+                        const auto nIterations = iterations.values[i]
+                                                     ? iterations.values[i]
+                                                     : std::max<std::size_t>(std::size_t{ITERATIONS} * N / nPages, 1);
+                        const auto nThreads = static_cast<unsigned>(threads.values[t]);
+                        std::cout << "----------------------------------------" << std::endl;
+                        points[nPoints++]
+                            = nThreads == 1 && !shared
+                                  ? run(objectSizes.values[s], objectDistances.values[d], nPages, nIterations,
+                                        distanceClampMax, sleepDelay)
+                                  : runThreads(objectSizes.values[s], objectDistances.values[d], nPages, nIterations,
+                                               nThreads, shared, sleepDelay);
+                    }
+                }
+            }
         }
     }
 
-    const auto end = std::chrono::high_resolution_clock::now();
-    const auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
-    std::cout << "Elapsed: " << duration << "ms" << std::endl;
-}
\ No newline at end of file
+    if (nPoints > 1) {
+        std::cout << "----------------------------------------" << std::endl;
+        std::cout << "size\tdistance\tpages\theap_mb\titerations\tthreads\tshared\treused\tkernel\tlittered_ns\t"
+                     "contiguous_ns\tlittered_mops\tcontiguous_mops\tslowdown"
+                  << std::endl;
+        for (const auto& point : points) {
+            for (std::size_t k = 0; k < nAccessKernels; ++k) {
+                if (point.littered[k] < 0) {
+                    continue;
+                }
+                std::cout << point.objectSize << "\t" << point.objectDistance << "\t" << point.nPages << "\t"
+                          << (double) point.nPages * point.objectDistance / (1 << 20) << "\t" << point.iterations
+                          << "\t" << point.threads << "\t" << point.shared << "\t" << point.reused << "\t"
+                          << accessKernels[k].name << "\t" << point.littered[k] << "\t" << point.contiguous[k] << "\t"
+                          << point.litteredRate[k] << "\t" << point.contiguousRate[k] << "\t"
+                          << point.contiguousRate[k] / point.litteredRate[k] << std::endl;
+            }
+        }
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+struct AddressRange {
+    std::uintptr_t start;
+    std::size_t size;
+
+    std::uintptr_t end() const {
+        return start + size;
+    }
+};
+
+struct Overlap {
+    // Allocated ranges starting where a freed range started, i.e. objects placed exactly in a hole.
+    std::size_t objects = 0;
+    // Bytes of the allocated ranges inside freed ranges.
+    std::size_t bytes = 0;
+};
+
+// Measures how much of `allocated` reuses `freed`, for objects of any size: both arrays are sorted by address, the
+// freed ranges are merged in place into disjoint ones (so `freed` no longer holds the original ranges afterwards), and
+// one sweep over both gives the overlap. O(n log n) with no memory beyond the two arrays, unlike sets of addresses or
+// bytes. Allocated ranges are counted on their own, so bytes where two of them overlap count twice.
+inline Overlap overlap(AddressRange* freed, std::size_t nFreed, AddressRange* allocated, std::size_t nAllocated) {
+    const auto byStart = [](const AddressRange& a, const AddressRange& b) { return a.start < b.start; };
+    std::sort(freed, freed + nFreed, byStart);
+    std::sort(allocated, allocated + nAllocated, byStart);
+
+    Overlap result;
+    for (std::size_t i = 0, j = 0; i < nAllocated; ++i) {
+        while (j < nFreed && freed[j].start < allocated[i].start) {
+            ++j;
+        }
+        result.objects += j < nFreed && freed[j].start == allocated[i].start;
+    }
+
+    std::size_t nMerged = 0;
+    for (std::size_t i = 0; i < nFreed; ++i) {
+        if (nMerged && freed[i].start <= freed[nMerged - 1].end()) {
+            AddressRange& last = freed[nMerged - 1];
+            last.size = std::max(last.end(), freed[i].end()) - last.start;
+        } else {
+            freed[nMerged++] = freed[i];
+        }
+    }
+
+    // Merged ranges end in increasing order, so those ending before an allocation also end before the next ones.
+    for (std::size_t i = 0, j = 0; i < nAllocated; ++i) {
+        const auto start = allocated[i].start;
+        const auto end = allocated[i].end();
+        while (j < nMerged && freed[j].end() <= start) {
+            ++j;
+        }
+        for (std::size_t k = j; k < nMerged && freed[k].start < end; ++k) {
+            result.bytes += std::min(end, freed[k].end()) - std::max(start, freed[k].start);
+        }
+    }
+    return result;
+}
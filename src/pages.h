@@ -0,0 +1,222 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+constexpr std::size_t smallPageSize = 4096;
+constexpr std::size_t hugePageSize = 2 << 20;
+
+inline std::size_t systemPageSize() {
+#if _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    return sysconf(_SC_PAGESIZE);
+#endif
+}
+
+// Parses a page granularity: "4k", "2m", "system", or a number of bytes. Returns 0 unless it is a power of two.
+inline std::size_t parsePageSize(const char* value) {
+    std::size_t size = 0;
+    if (std::strcmp(value, "4k") == 0) {
+        size = smallPageSize;
+    } else if (std::strcmp(value, "2m") == 0) {
+        size = hugePageSize;
+    } else if (std::strcmp(value, "system") == 0) {
+        size = systemPageSize();
+    } else {
+        size = std::strtoull(value, nullptr, 10);
+    }
+    return (size && (size & (size - 1)) == 0) ? size : 0;
+}
+
+// Page granularity from LITTER_PAGE_SIZE, defaulting to the system page size.
+inline std::size_t pageSizeFromEnvironment() {
+    const char* env = std::getenv("LITTER_PAGE_SIZE");
+    return env ? parsePageSize(env) : systemPageSize();
+}
+
+// An array mapped from the OS instead of allocated from the heap under test, so that the benchmark's own storage
+// neither fragments that heap nor sits on the stack. Zeroed, and only resident where touched: it can be sized for GBs
+// of objects up front. Exits if the mapping fails.
+template <typename T>
+class MappedArray {
+  public:
+    explicit MappedArray(std::size_t n) : n(n), bytes((n ? n : 1) * sizeof(T)) {
+#if _WIN32
+        void* memory = VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+        const bool failed = !memory;
+#else
+        void* memory
+            = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        const bool failed = memory == MAP_FAILED;
+#endif
+        if (failed) {
+            std::fprintf(stderr, "Could not map %zu bytes.\n", bytes);
+            std::exit(EXIT_FAILURE);
+        }
+        elements = static_cast<T*>(memory);
+    }
+
+    ~MappedArray() {
+#if _WIN32
+        VirtualFree(elements, 0, MEM_RELEASE);
+#else
+        munmap(elements, bytes);
+#endif
+    }
+
+    MappedArray(const MappedArray&) = delete;
+    MappedArray& operator=(const MappedArray&) = delete;
+
+    T& operator[](std::size_t i) {
+        return elements[i];
+    }
+
+    const T& operator[](std::size_t i) const {
+        return elements[i];
+    }
+
+    T* data() {
+        return elements;
+    }
+
+    std::size_t size() const {
+        return n;
+    }
+
+    T* begin() {
+        return elements;
+    }
+
+    T* end() {
+        return elements + n;
+    }
+
+  private:
+    std::size_t n;
+    std::size_t bytes;
+    T* elements = nullptr;
+};
+
+#if !_WIN32
+// Reads a small file, such as one in /proc or /sys, into `buffer` without allocating: NUL-terminated, without its
+// trailing newline, and truncated to fit. Returns false, leaving `buffer` as it was, if it cannot be read or is empty.
+inline bool readSmallFile(const char* path, char* buffer, std::size_t size) {
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    std::size_t filled = 0;
+    while (filled < size - 1) {
+        const auto n = read(fd, buffer + filled, size - filled - 1);
+        if (n <= 0) {
+            break;
+        }
+        filled += n;
+    }
+    close(fd);
+    if (filled == 0) {
+        return false;
+    }
+    filled -= buffer[filled - 1] == '\n';
+    buffer[filled] = '\0';
+    return true;
+}
+#endif
+
+// Resident set size of the process from /proc/self/statm, or 0 where it is not available. Never allocates.
+inline std::size_t residentBytes() {
+#if !_WIN32
+    char buffer[128];
+    if (!readSmallFile("/proc/self/statm", buffer, sizeof(buffer))) {
+        return 0;
+    }
+
+    // "size resident shared text lib data dt", in pages.
+    char* resident = nullptr;
+    std::strtoull(buffer, &resident, 10);
+    return std::strtoull(resident, nullptr, 10) * systemPageSize();
+#else
+    return 0;
+#endif
+}
+
+struct HugePageUsage {
+    // False where /proc/self/smaps is not available.
+    bool available = false;
+    std::size_t rss = 0;
+    std::size_t anonHugePages = 0;
+    std::size_t totalAnonHugePages = 0;
+};
+
+// Sums Rss and AnonHugePages from /proc/self/smaps over the mappings overlapping [start, end), along with the process
+// total of AnonHugePages. Parses with a fixed buffer on the stack, so it never allocates.
+inline HugePageUsage hugePageUsage(std::uintptr_t start, std::uintptr_t end) {
+    HugePageUsage usage;
+#if !_WIN32
+    const int fd = open("/proc/self/smaps", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return usage;
+    }
+    usage.available = true;
+
+    char buffer[1 << 16];
+    std::size_t filled = 0;
+    bool overlapping = false;
+    for (;;) {
+        const auto n = read(fd, buffer + filled, sizeof(buffer) - filled - 1);
+        if (n <= 0) {
+            break;
+        }
+        filled += n;
+        buffer[filled] = '\0';
+
+        char* line = buffer;
+        while (char* newline = std::strchr(line, '\n')) {
+            *newline = '\0';
+            const auto field = [&](const char* name) -> std::size_t {
+                const std::size_t length = std::strlen(name);
+                return std::strncmp(line, name, length) == 0 ? std::strtoull(line + length, nullptr, 10) << 10 : 0;
+            };
+
+            char* rangeEnd = nullptr;
+            const auto mappingStart = std::strtoull(line, &rangeEnd, 16);
+            if (rangeEnd && *rangeEnd == '-' && rangeEnd != line) {
+                // Mapping header: "start-end perms offset device inode path".
+                const auto mappingEnd = std::strtoull(rangeEnd + 1, nullptr, 16);
+                overlapping = mappingStart < end && mappingEnd > start;
+            } else if (const auto anonHugePages = field("AnonHugePages:")) {
+                usage.totalAnonHugePages += anonHugePages;
+                usage.anonHugePages += overlapping ? anonHugePages : 0;
+            } else if (overlapping) {
+                usage.rss += field("Rss:");
+            }
+            line = newline + 1;
+        }
+
+        filled = buffer + filled - line;
+        std::memmove(buffer, line, filled);
+    }
+    close(fd);
+#else
+    (void) start;
+    (void) end;
+#endif
+    return usage;
+}
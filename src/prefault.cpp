@@ -0,0 +1,83 @@
+#include "prefault.h"
+
+#include <algorithm>
+
+#include "pages.h"
+#include "threads.h"
+
+#if !_WIN32
+#include <sys/mman.h>
+#endif
+
+#if !_WIN32 && defined(MADV_POPULATE_WRITE)
+namespace {
+// Below this, starting another thread costs more than the page faults it would take over.
+constexpr std::size_t minBytesPerThread = 32 << 20;
+constexpr unsigned maxPrefaultThreads = 256;
+
+struct Worker {
+    std::span<const PageRange> ranges;
+    // Byte window of the concatenated ranges this worker is responsible for.
+    std::size_t windowStart;
+    std::size_t windowEnd;
+    std::size_t bytes;
+};
+
+void populate(Worker& worker) {
+    std::size_t offset = 0;
+    for (const auto& range : worker.ranges) {
+        const std::size_t size = range.end - range.start;
+        const std::size_t from = std::max(offset, worker.windowStart);
+        const std::size_t to = std::min(offset + size, worker.windowEnd);
+        offset += size;
+
+        if (from >= to) {
+            continue;
+        }
+        void* start = reinterpret_cast<void*>(range.start + (from - (offset - size)));
+        if (madvise(start, to - from, MADV_POPULATE_WRITE) == 0) {
+            worker.bytes += to - from;
+        }
+    }
+}
+
+// Checks that the running kernel knows about MADV_POPULATE_WRITE (Linux 5.14+).
+bool populateSupported() {
+    return madvise(nullptr, 0, MADV_POPULATE_WRITE) == 0;
+}
+} // namespace
+
+PrefaultResult prefault(std::span<const PageRange> ranges, unsigned maxThreads) {
+    if (!populateSupported()) {
+        return {false, 0, 0};
+    }
+
+    std::size_t totalBytes = 0;
+    for (const auto& range : ranges) {
+        totalBytes += range.end - range.start;
+    }
+
+    const auto nThreads = static_cast<unsigned>(std::clamp<std::size_t>(
+        totalBytes / minBytesPerThread, 1, std::clamp(maxThreads, 1u, maxPrefaultThreads)));
+    // madvise needs each worker's window to start on a page of the system's size.
+    const std::size_t pageSize = systemPageSize();
+    const std::size_t share = (totalBytes / nThreads + pageSize - 1) & ~(pageSize - 1);
+
+    Worker workers[maxPrefaultThreads];
+    for (unsigned i = 0; i < nThreads; ++i) {
+        workers[i] = {ranges, i * share, i + 1 == nThreads ? totalBytes : (i + 1) * share, 0};
+    }
+    runOnThreads(nThreads, [&](unsigned i) { populate(workers[i]); });
+
+    std::size_t bytes = 0;
+    for (unsigned i = 0; i < nThreads; ++i) {
+        bytes += workers[i].bytes;
+    }
+
+    return {true, bytes, nThreads};
+}
+#else
+PrefaultResult prefault(std::span<const PageRange>, unsigned) {
+    return {false, 0, 0};
+}
+#endif
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+struct PageRange {
+    std::uintptr_t start;
+    std::uintptr_t end;
+};
+
+struct PrefaultResult {
+    // False if the platform or kernel lacks MADV_POPULATE_WRITE, in which case nothing was done.
+    bool supported;
+    std::size_t bytes;
+    unsigned threads;
+};
+
+// Makes every page of `ranges` resident and writable with MADV_POPULATE_WRITE. Large inputs are split evenly by bytes
+// across up to `maxThreads` threads, including the calling one. Ranges that can no longer be populated are skipped.
+PrefaultResult prefault(std::span<const PageRange> ranges, unsigned maxThreads);
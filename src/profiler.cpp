@@ -0,0 +1,366 @@
+#include "profiler.h"
+
+#if __linux__
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <dlfcn.h>
+#include <link.h>
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include "counters.h"
+
+namespace {
+enum Event { Cycles, Instructions, LlcMisses, NEvents };
+constexpr const char* eventNames[NEvents] = {"cycles", "instructions", "LLC-load-misses"};
+
+constexpr std::size_t maxSamples = std::size_t{1} << 22;
+// Per CPU, drained every 10 ms: room for about 4000 samples each.
+constexpr std::size_t ringPages = 16;
+constexpr unsigned maxCpus = 1024;
+
+// Sample addresses per event, in private mappings.
+struct Samples {
+    std::uintptr_t* ips = nullptr;
+    std::atomic_size_t count{0};
+    std::size_t lost = 0;
+};
+Samples samples[NEvents];
+
+struct Ring {
+    int fd = -1;
+    perf_event_mmap_page* header = nullptr;
+    char* data = nullptr;
+    std::size_t size = 0;
+};
+// One ring per event and CPU: the kernel only maps inherited events, which follow the program's threads, when they are
+// bound to a CPU.
+Ring rings[NEvents][maxCpus];
+unsigned nCpus = 0;
+bool eventAvailable[NEvents];
+
+bool started = false;
+bool usingTimer = false;
+unsigned frequency = 0;
+timer_t timer;
+pthread_t drainThread;
+std::atomic_bool stopping{false};
+
+[[noreturn]] void exitWithError(const char* message) {
+    fprintf(stderr, "[ERROR] %s\n", message);
+    exit(EXIT_FAILURE);
+}
+
+void* mapMemory(std::size_t size) {
+    void* memory
+        = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (memory == MAP_FAILED) {
+        exitWithError("LITTER_SAMPLING: could not map the sample buffers.");
+    }
+    return memory;
+}
+
+void addSample(Event event, std::uintptr_t ip) {
+    const auto i = samples[event].count.fetch_add(1, std::memory_order_relaxed);
+    if (i < maxSamples) {
+        samples[event].ips[i] = ip;
+    }
+}
+
+bool openRing(Ring& ring, unsigned cpu, std::uint32_t type, std::uint64_t config) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.freq = 1;
+    attr.sample_freq = frequency;
+    attr.sample_type = PERF_SAMPLE_IP;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    const int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, cpu, -1, PERF_FLAG_FD_CLOEXEC));
+    if (fd < 0) {
+        return false;
+    }
+
+    // One metadata page, then a power of two of data pages. The events inherited by threads running on this CPU write
+    // to this ring too.
+    const std::size_t pageSize = sysconf(_SC_PAGESIZE);
+    void* memory = mmap(nullptr, (ringPages + 1) * pageSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (memory == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+    ring.fd = fd;
+    ring.header = static_cast<perf_event_mmap_page*>(memory);
+    ring.data = static_cast<char*>(memory) + pageSize;
+    ring.size = ringPages * pageSize;
+    return true;
+}
+
+// Opens the event on every CPU it can, skipping offline ones. Returns whether it is available at all.
+bool openRings(Event event, std::uint32_t type, std::uint64_t config) {
+    for (unsigned cpu = 0; cpu < nCpus; ++cpu) {
+        eventAvailable[event] |= openRing(rings[event][cpu], cpu, type, config);
+    }
+    return eventAvailable[event];
+}
+
+// Enables or disables every ring.
+void controlRings(unsigned long request) {
+    for (const auto& eventRings : rings) {
+        for (unsigned cpu = 0; cpu < nCpus; ++cpu) {
+            if (eventRings[cpu].fd >= 0) {
+                ioctl(eventRings[cpu].fd, request, 0);
+            }
+        }
+    }
+}
+
+// Moves the samples out of a ring buffer, copying records that wrap around its end.
+void drainRing(Event event, Ring& ring) {
+    if (!ring.header) {
+        return;
+    }
+    const std::uint64_t head = __atomic_load_n(&ring.header->data_head, __ATOMIC_ACQUIRE);
+    std::uint64_t tail = ring.header->data_tail;
+    while (tail < head) {
+        char record[64];
+        perf_event_header recordHeader;
+        const auto copy = [&](void* to, std::uint64_t offset, std::size_t size) {
+            for (std::size_t i = 0; i < size; ++i) {
+                static_cast<char*>(to)[i] = ring.data[(offset + i) % ring.size];
+            }
+        };
+        copy(&recordHeader, tail, sizeof(recordHeader));
+        if (recordHeader.size < sizeof(recordHeader)) {
+            break;
+        }
+        if (recordHeader.type == PERF_RECORD_SAMPLE && recordHeader.size <= sizeof(record)) {
+            std::uint64_t ip;
+            copy(&ip, tail + sizeof(recordHeader), sizeof(ip));
+            addSample(event, ip);
+        } else if (recordHeader.type == PERF_RECORD_LOST && recordHeader.size <= sizeof(record)) {
+            copy(record, tail, recordHeader.size);
+            std::uint64_t lost;
+            std::memcpy(&lost, record + sizeof(recordHeader) + sizeof(std::uint64_t), sizeof(lost));
+            samples[event].lost += lost;
+        }
+        tail += recordHeader.size;
+    }
+    __atomic_store_n(&ring.header->data_tail, tail, __ATOMIC_RELEASE);
+}
+
+void drainAll() {
+    for (unsigned event = 0; event < NEvents; ++event) {
+        for (unsigned cpu = 0; cpu < nCpus; ++cpu) {
+            drainRing(static_cast<Event>(event), rings[event][cpu]);
+        }
+    }
+}
+
+// Created with pthreads, since std::thread would allocate.
+void* drainRings(void*) {
+    while (!stopping.load()) {
+        drainAll();
+        recordHelperUsage(Helper::Profiler);
+        const timespec interval = {0, 10'000'000};
+        nanosleep(&interval, nullptr);
+    }
+    return nullptr;
+}
+
+void onProfilingSignal(int, siginfo_t*, void* context) {
+    const auto* ucontext = static_cast<const ucontext_t*>(context);
+#if defined(__x86_64__)
+    const std::uintptr_t ip = ucontext->uc_mcontext.gregs[REG_RIP];
+#elif defined(__aarch64__)
+    const std::uintptr_t ip = ucontext->uc_mcontext.pc;
+#else
+    (void) ucontext;
+    const std::uintptr_t ip = 0;
+#endif
+    // CPU time timers expire on scheduler ticks, so several periods can elapse per signal; weigh the sample by them.
+    const int overruns = std::clamp(timer_getoverrun(timer), 0, 64);
+    for (int i = 0; i <= overruns; ++i) {
+        addSample(Cycles, ip);
+    }
+}
+
+bool startTimer() {
+    struct sigaction action = {};
+    action.sa_sigaction = onProfilingSignal;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, nullptr) != 0) {
+        return false;
+    }
+
+    // CPU time of the whole process, so every thread is sampled.
+    sigevent event = {};
+    event.sigev_notify = SIGEV_SIGNAL;
+    event.sigev_signo = SIGPROF;
+    if (timer_create(CLOCK_PROCESS_CPUTIME_ID, &event, &timer) != 0) {
+        return false;
+    }
+    const long period = 1'000'000'000L / frequency;
+    const itimerspec spec = {{period / 1'000'000'000L, period % 1'000'000'000L},
+                             {period / 1'000'000'000L, period % 1'000'000'000L}};
+    return timer_settime(timer, 0, &spec, nullptr) == 0;
+}
+
+// A loaded object's executable address range.
+struct Range {
+    std::uintptr_t start;
+    std::uintptr_t end;
+    unsigned object;
+};
+
+constexpr unsigned maxObjects = 512;
+constexpr unsigned maxRanges = 2048;
+
+struct RangeTable {
+    const char* names[maxObjects];
+    unsigned nObjects = 0;
+    Range ranges[maxRanges];
+    unsigned nRanges = 0;
+
+    // Index of the object holding `ip`, or nObjects if there is none.
+    unsigned find(std::uintptr_t ip) const {
+        const auto it = std::upper_bound(ranges, ranges + nRanges, ip,
+                                         [](std::uintptr_t value, const Range& range) { return value < range.start; });
+        if (it == ranges || ip >= (it - 1)->end) {
+            return nObjects;
+        }
+        return (it - 1)->object;
+    }
+};
+RangeTable table;
+
+int addObject(dl_phdr_info* info, std::size_t, void*) {
+    if (table.nObjects == maxObjects) {
+        return 1;
+    }
+    const unsigned object = table.nObjects++;
+    table.names[object] = info->dlpi_name && *info->dlpi_name ? info->dlpi_name : "[program]";
+    for (unsigned i = 0; i < info->dlpi_phnum && table.nRanges < maxRanges; ++i) {
+        const auto& header = info->dlpi_phdr[i];
+        if (header.p_type == PT_LOAD && (header.p_flags & PF_X)) {
+            const std::uintptr_t start = info->dlpi_addr + header.p_vaddr;
+            table.ranges[table.nRanges++] = {start, start + header.p_memsz, object};
+        }
+    }
+    return 0;
+}
+
+// The object defining malloc, looking past this library's own malloc hook when there is one.
+unsigned allocatorObject() {
+    Dl_info self;
+    Dl_info info;
+    void* malloc = dlsym(RTLD_DEFAULT, "malloc");
+    if (dladdr(reinterpret_cast<void*>(&allocatorObject), &self) && malloc && dladdr(malloc, &info)
+        && info.dli_fbase == self.dli_fbase) {
+        malloc = dlsym(RTLD_NEXT, "malloc");
+    }
+    return malloc ? table.find(reinterpret_cast<std::uintptr_t>(malloc)) : table.nObjects;
+}
+} // namespace
+
+void startProfiler() {
+    const char* env = std::getenv("LITTER_SAMPLING");
+    if (!env || !atoi(env)) {
+        return;
+    }
+    frequency = atoi(env);
+    if (frequency > 100'000) {
+        exitWithError("LITTER_SAMPLING must be a sampling frequency in Hz, at most 100000.");
+    }
+    for (auto& eventSamples : samples) {
+        eventSamples.ips = static_cast<std::uintptr_t*>(mapMemory(maxSamples * sizeof(std::uintptr_t)));
+    }
+
+    nCpus = static_cast<unsigned>(std::clamp<long>(sysconf(_SC_NPROCESSORS_CONF), 1, maxCpus));
+    const bool haveCycles = openRings(Cycles, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    if (haveCycles) {
+        openRings(Instructions, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+        constexpr std::uint64_t llcMisses
+            = PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        openRings(LlcMisses, PERF_TYPE_HW_CACHE, llcMisses);
+        if (pthread_create(&drainThread, nullptr, drainRings, nullptr) != 0) {
+            exitWithError("LITTER_SAMPLING: could not create the sample thread.");
+        }
+        controlRings(PERF_EVENT_IOC_ENABLE);
+    } else if (startTimer()) {
+        usingTimer = true;
+    } else {
+        fprintf(stderr, "[WARNING] LITTER_SAMPLING: neither perf events nor a profiling timer are available.\n");
+        return;
+    }
+    started = true;
+}
+
+void reportProfiler() {
+    if (!started) {
+        return;
+    }
+    if (usingTimer) {
+        timer_delete(timer);
+    } else {
+        controlRings(PERF_EVENT_IOC_DISABLE);
+        stopping.store(true);
+        pthread_join(drainThread, nullptr);
+        drainAll();
+    }
+
+    dl_iterate_phdr(addObject, nullptr);
+    std::sort(table.ranges, table.ranges + table.nRanges,
+              [](const Range& a, const Range& b) { return a.start < b.start; });
+    const unsigned allocator = allocatorObject();
+
+    fprintf(stderr, "Sampling: %s at %u Hz, allocator %s\n",
+            usingTimer ? "SIGPROF timer (CPU time)" : "perf_event_open", frequency,
+            allocator < table.nObjects ? table.names[allocator] : "unknown");
+    for (unsigned event = 0; event < NEvents; ++event) {
+        if (usingTimer ? event != Cycles : !eventAvailable[event]) {
+            fprintf(stderr, "%s: unavailable\n", eventNames[event]);
+            continue;
+        }
+
+        // One extra slot for addresses outside of any object, e.g. in JIT code.
+        std::size_t counts[maxObjects + 1] = {};
+        const std::size_t n = std::min(samples[event].count.load(), maxSamples);
+        for (std::size_t i = 0; i < n; ++i) {
+            ++counts[table.find(samples[event].ips[i])];
+        }
+
+        fprintf(stderr, "%s: %zu sample(s)%s, %.1f%% in the allocator\n", eventNames[event], n,
+                samples[event].lost || samples[event].count.load() > maxSamples ? " (some lost)" : "",
+                n && allocator < table.nObjects ? 100.0 * counts[allocator] / n : 0.0);
+        for (unsigned object = 0; object <= table.nObjects; ++object) {
+            if (n && counts[object] * 100 >= n) {
+                fprintf(stderr, "\t%s: %.1f%%\n", object < table.nObjects ? table.names[object] : "[unknown]",
+                        100.0 * counts[object] / n);
+            }
+        }
+    }
+}
+#else
+void startProfiler() {}
+
+void reportProfiler() {}
+#endif
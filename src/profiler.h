@@ -0,0 +1,15 @@
+#pragma once
+
+// Samples where the program spends its time, from after littering to exit (LITTER_SAMPLING=<Hz>), and reports the share
+// of cycles, instructions and last level cache misses that falls in the allocator, the object defining malloc, and in
+// every other loaded object. Samples come from perf_event_open, with one event per CPU (inherited events can only be
+// mapped when bound to a CPU) inherited by every thread the program creates; where no PMU is available, e.g. on most
+// VMs, CPU time is sampled with a SIGPROF timer instead, which gives the cycles share only. Sample addresses are mapped
+// to objects with a range table built from dl_iterate_phdr at exit, so the program's run pays only for taking the
+// samples. Nothing here allocates from the littered heap.
+
+// Reads LITTER_SAMPLING and starts sampling; exits on invalid values.
+void startProfiler();
+
+// Stops sampling and prints the shares to stderr, if sampling was started.
+void reportProfiler();
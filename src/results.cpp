@@ -0,0 +1,321 @@
+#include "results.h"
+
+#include <cerrno>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "counters.h"
+#include "memory-sampler.h"
+#include "pages.h"
+
+using litterer::LitterConfig;
+using litterer::LitterStatistics;
+using litterer::TargetMetric;
+
+namespace {
+struct Pass {
+    LitterConfig config;
+    LitterStatistics stats;
+};
+
+constexpr std::size_t maxPasses = 16;
+
+Pass passes[maxPasses];
+std::size_t nPasses = 0;
+std::size_t nDroppedPasses = 0;
+
+// Builds JSON into a fixed buffer, remembering whether it ran out of space rather than writing a truncated record.
+class JsonWriter {
+  public:
+    JsonWriter(char* buffer, std::size_t size) : buffer(buffer), size(size) {}
+
+    void beginObject(const char* key = nullptr) {
+        open(key, '{');
+    }
+
+    void endObject() {
+        close('}');
+    }
+
+    void beginArray(const char* key) {
+        open(key, '[');
+    }
+
+    void endArray() {
+        close(']');
+    }
+
+    void string(const char* key, const char* value) {
+        if (!value) {
+            null(key);
+            return;
+        }
+        name(key);
+        put('"');
+        for (const char* c = value; *c; ++c) {
+            const auto byte = static_cast<unsigned char>(*c);
+            if (byte == '"' || byte == '\\') {
+                put('\\');
+                put(*c);
+            } else if (byte < 0x20) {
+                append("\\u%04x", byte);
+            } else {
+                put(*c);
+            }
+        }
+        put('"');
+    }
+
+    void integer(const char* key, long long value) {
+        name(key);
+        append("%lld", value);
+    }
+
+    void number(const char* key, double value) {
+        if (!std::isfinite(value)) {
+            null(key);
+            return;
+        }
+        name(key);
+        append("%.9g", value);
+    }
+
+    void boolean(const char* key, bool value) {
+        name(key);
+        append("%s", value ? "true" : "false");
+    }
+
+    void null(const char* key) {
+        name(key);
+        append("null");
+    }
+
+    // The length of the record, or 0 if it did not fit.
+    std::size_t finish() {
+        put('\n');
+        return overflow ? 0 : used;
+    }
+
+  private:
+    char* buffer;
+    std::size_t size;
+    std::size_t used = 0;
+    bool overflow = false;
+    // No comma before the first member of an object or array.
+    bool first = true;
+
+    void open(const char* key, char bracket) {
+        name(key);
+        put(bracket);
+        first = true;
+    }
+
+    void close(char bracket) {
+        put(bracket);
+        first = false;
+    }
+
+    void name(const char* key) {
+        if (!first) {
+            put(',');
+        }
+        first = false;
+        if (key) {
+            put('"');
+            append("%s", key);
+            put('"');
+            put(':');
+        }
+    }
+
+    void put(char c) {
+        if (used + 1 < size) {
+            buffer[used++] = c;
+        } else {
+            overflow = true;
+        }
+    }
+
+    __attribute__((format(printf, 2, 3))) void append(const char* format, ...) {
+        va_list arguments;
+        va_start(arguments, format);
+        const int n = std::vsnprintf(buffer + used, size - used, format, arguments);
+        va_end(arguments);
+        if (n < 0 || used + n >= size) {
+            overflow = true;
+        } else {
+            used += n;
+        }
+    }
+};
+
+void writePass(JsonWriter& json, const Pass& pass) {
+    const LitterConfig& config = pass.config;
+    const LitterStatistics& stats = pass.stats;
+
+    json.beginObject();
+    json.string("profile", config.profile);
+    json.string("phase", config.phase);
+    json.integer("seed", stats.seed);
+    json.number("occupancy", config.occupancy);
+    json.integer("multiplier", config.multiplier);
+    json.string("freeStrategy", freeStrategyName(config.freeStrategy));
+    json.string("touch", touchModeName(config.touch));
+    json.integer("pageSize", static_cast<long long>(config.pageSize ? config.pageSize : systemPageSize()));
+    json.integer("producers", config.producers);
+    json.integer("consumers", config.consumers);
+    json.boolean("reallocChains", config.reallocChains);
+    json.boolean("apiMix", config.apiMix);
+    json.string("purge", purgeModeName(config.purge));
+    json.string("malloc", stats.mallocObject);
+    json.string("allocator", stats.allocator);
+
+    json.integer("allocated", static_cast<long long>(stats.allocated));
+    json.integer("freed", static_cast<long long>(stats.freed));
+    json.integer("retained", static_cast<long long>(stats.retained));
+    json.integer("remoteFrees", static_cast<long long>(stats.remoteFrees));
+    json.integer("pinnedPages", static_cast<long long>(stats.pinnedPages));
+    if (config.reallocChains) {
+        json.number("cleanReallocMoveRate", stats.cleanReallocMoveRate);
+        json.number("litteredReallocMoveRate", stats.litteredReallocMoveRate);
+    }
+    if (config.apiMix) {
+        json.integer("alignedAllocations", static_cast<long long>(stats.alignedAllocations));
+        json.integer("alignmentWasteBytes", static_cast<long long>(stats.alignmentWasteBytes));
+    }
+    if (config.target.metric != TargetMetric::None) {
+        json.beginObject("target");
+        json.string("metric", targetMetricName(config.target.metric));
+        json.number("value", config.target.value);
+        json.integer("rounds", static_cast<long long>(stats.rounds));
+        json.number("measured", stats.targetMeasured);
+        json.boolean("reached", stats.targetReached);
+        json.endObject();
+    }
+    if (config.generations.maxGenerations) {
+        json.beginObject("generations");
+        json.string("metric", targetMetricName(config.generations.metric));
+        json.integer("generations", static_cast<long long>(stats.generations));
+        json.number("measured", stats.generationMeasured);
+        json.boolean("converged", stats.converged);
+        json.endObject();
+    }
+
+    json.integer("litterNs", std::llround(stats.milliseconds * 1e6));
+    json.beginObject("stepNs");
+    for (std::size_t i = 0; i < stats.nSteps; ++i) {
+        json.integer(stats.steps[i].name, static_cast<long long>(stats.steps[i].nanoseconds));
+    }
+    json.endObject();
+    json.integer("pageFaults", stats.pageFaults);
+    json.integer("purgedBytes", stats.purgedBytes);
+    json.integer("bookkeepingBytes", static_cast<long long>(stats.bookkeepingBytes));
+    json.endObject();
+}
+
+void writeCounters(JsonWriter& json) {
+    const auto readings = readCounters();
+    json.beginObject("rusage");
+    json.integer("maxRssKb", readings.maxRssKb);
+    json.integer("minorFaults", readings.minorFaults);
+    json.integer("majorFaults", readings.majorFaults);
+    json.integer("voluntarySwitches", readings.voluntarySwitches);
+    json.integer("involuntarySwitches", readings.involuntarySwitches);
+    json.endObject();
+
+    if (!readings.eventsEnabled) {
+        json.null("counters");
+        return;
+    }
+    json.beginObject("counters");
+    for (std::size_t i = 0; i < sizeof(readings.events) / sizeof(readings.events[0]); ++i) {
+        if (readings.events[i] < 0) {
+            json.null(counterNames[i]);
+        } else {
+            json.number(counterNames[i], readings.events[i]);
+        }
+    }
+    json.endObject();
+}
+
+void writeMemory(JsonWriter& json) {
+    const auto summary = memorySummary();
+    if (!summary.nSamples) {
+        json.null("memory");
+        return;
+    }
+    json.beginObject("memory");
+    json.integer("samples", static_cast<long long>(summary.nSamples));
+    json.integer("peakRssKb", static_cast<long long>(summary.peakRssKb));
+    json.integer("peakAnonHugeKb", static_cast<long long>(summary.peakAnonHugeKb));
+    if (summary.peakActiveBytes < 0) {
+        json.null("peakActiveBytes");
+    } else {
+        json.integer("peakActiveBytes", summary.peakActiveBytes);
+    }
+    json.endObject();
+}
+} // namespace
+
+void recordLitterPass(const litterer::Litter& litter) {
+    if (nPasses == maxPasses) {
+        ++nDroppedPasses;
+        return;
+    }
+    passes[nPasses++] = {litter.config(), litter.statistics()};
+}
+
+void writeResults(std::uint64_t programNanoseconds) {
+    const char* filename = std::getenv("LITTER_RESULTS_FILENAME");
+    if (!filename) {
+        return;
+    }
+
+    // Static, since a record with many passes is too large for the stack of a thread near its end.
+    static char buffer[1 << 16];
+    JsonWriter json(buffer, sizeof(buffer));
+    json.beginObject();
+    json.integer("time", static_cast<long long>(std::time(nullptr)));
+    json.integer("pid", getpid());
+#if __linux__
+    json.string("program", program_invocation_name);
+#else
+    json.null("program");
+#endif
+    const char* trigger = std::getenv("LITTER_TRIGGER");
+    json.string("trigger", trigger ? trigger : "start");
+    json.beginArray("passes");
+    for (std::size_t i = 0; i < nPasses; ++i) {
+        writePass(json, passes[i]);
+    }
+    json.endArray();
+    json.integer("droppedPasses", static_cast<long long>(nDroppedPasses));
+    json.integer("programNs", static_cast<long long>(programNanoseconds));
+    writeCounters(json);
+    writeMemory(json);
+    json.endObject();
+
+    const auto length = json.finish();
+    if (!length) {
+        fprintf(stderr, "[WARNING] The results record does not fit in %zu bytes; nothing written.\n", sizeof(buffer));
+        return;
+    }
+    const int fd = open(filename, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "[WARNING] Could not write the results to %s (%s).\n", filename, std::strerror(errno));
+        return;
+    }
+    const auto written = write(fd, buffer, length);
+    if (written != static_cast<ssize_t>(length)) {
+        fprintf(stderr, "[WARNING] Could not write the results to %s (%s).\n", filename,
+                written < 0 ? std::strerror(errno) : "short write");
+    }
+    close(fd);
+}
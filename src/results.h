@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+
+#include <litterer/litterer.h>
+
+// Appends one JSON object per run, on a single line, to LITTER_RESULTS_FILENAME: the trigger, the configuration, seed,
+// allocator and step timings (in nanoseconds) of every litter pass, the program's time, its counters and a summary of
+// the memory samples. The record is built in static buffers and written with a single write() to a file opened with
+// O_APPEND, so that nothing allocates and runs appending to the same file do not interleave.
+
+// Keeps the configuration and statistics of a finished litter pass, up to the first 16.
+void recordLitterPass(const litterer::Litter& litter);
+
+// Writes the record, if LITTER_RESULTS_FILENAME is set.
+void writeResults(std::uint64_t programNanoseconds);
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer thread. The caller provides the storage,
+// whose capacity must be a power of two.
+template <typename T>
+class SpscQueue {
+  public:
+    SpscQueue(T* storage, std::size_t capacity) : storage(storage), mask(capacity - 1) {}
+
+    // Producer side. Returns false if the queue is full.
+    bool tryPush(T value) {
+        const auto tail = this->tail.load(std::memory_order_relaxed);
+        if (tail - cachedHead > mask) {
+            cachedHead = head.load(std::memory_order_acquire);
+            if (tail - cachedHead > mask) {
+                return false;
+            }
+        }
+        storage[tail & mask] = value;
+        this->tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Producer side: no more values will be pushed.
+    void close() {
+        closed.store(true, std::memory_order_release);
+    }
+
+    // Consumer side. Returns false if the queue is empty.
+    bool tryPop(T& value) {
+        const auto head = this->head.load(std::memory_order_relaxed);
+        if (head == cachedTail) {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if (head == cachedTail) {
+                return false;
+            }
+        }
+        value = storage[head & mask];
+        this->head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side: true once the producer has closed the queue and every value has been popped.
+    bool drained() {
+        if (!closed.load(std::memory_order_acquire)) {
+            return false;
+        }
+        cachedTail = tail.load(std::memory_order_acquire);
+        return head.load(std::memory_order_relaxed) == cachedTail;
+    }
+
+  private:
+    static constexpr std::size_t cacheLineSize = 64;
+
+    T* storage;
+    std::size_t mask;
+
+    // Each side's index and its cached copy of the other side's live on their own cache line.
+    alignas(cacheLineSize) std::atomic<std::size_t> tail{0};
+    std::size_t cachedHead = 0;
+    alignas(cacheLineSize) std::atomic<std::size_t> head{0};
+    std::size_t cachedTail = 0;
+    alignas(cacheLineSize) std::atomic<bool> closed{false};
+};
@@ -0,0 +1,104 @@
+#include "stabilize.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/personality.h>
+#include <unistd.h>
+
+namespace {
+char** programArgv = nullptr;
+
+// glibc passes the program's arguments to ELF constructors, which is the only way to get them before main. This runs
+// before the litterer's own initialization.
+__attribute__((constructor(101))) void captureArguments(int, char** argv, char**) {
+    programArgv = argv;
+}
+
+[[noreturn]] void exitWithError(const char* message) {
+    fprintf(stderr, "[ERROR] %s\n", message);
+    exit(EXIT_FAILURE);
+}
+
+// Parses a CPU list such as "0,2-3" into `cpus`. Returns false if it is malformed or names no CPU.
+bool parseCpuList(const char* list, cpu_set_t& cpus) {
+    CPU_ZERO(&cpus);
+    const char* cursor = list;
+    for (;;) {
+        char* end = nullptr;
+        const auto first = std::strtoul(cursor, &end, 10);
+        if (end == cursor) {
+            return false;
+        }
+        auto last = first;
+        if (*end == '-') {
+            cursor = end + 1;
+            last = std::strtoul(cursor, &end, 10);
+            if (end == cursor || last < first) {
+                return false;
+            }
+        }
+        if (last >= CPU_SETSIZE) {
+            return false;
+        }
+        for (auto cpu = first; cpu <= last; ++cpu) {
+            CPU_SET(cpu, &cpus);
+        }
+        if (*end == '\0') {
+            return CPU_COUNT(&cpus) > 0;
+        }
+        if (*end != ',') {
+            return false;
+        }
+        cursor = end + 1;
+    }
+}
+
+// Re-executes the program unless randomization is already off, e.g. because this is the re-executed program.
+void disableRandomization() {
+    const int current = personality(0xffffffff);
+    if (current == -1 || (current & ADDR_NO_RANDOMIZE)) {
+        return;
+    }
+    if (personality(current | ADDR_NO_RANDOMIZE) == -1 || !programArgv) {
+        fprintf(stderr, "[WARNING] LITTER_STABILIZE: could not disable address randomization (%s).\n",
+                std::strerror(errno));
+        return;
+    }
+    execv("/proc/self/exe", programArgv);
+    fprintf(stderr, "[WARNING] LITTER_STABILIZE: could not re-execute the program (%s).\n", std::strerror(errno));
+}
+} // namespace
+
+void stabilize() {
+    if (const char* env = std::getenv("LITTER_STABILIZE"); env && atoi(env)) {
+        disableRandomization();
+    }
+
+    if (const char* env = std::getenv("LITTER_CPUS")) {
+        cpu_set_t cpus;
+        if (!parseCpuList(env, cpus)) {
+            exitWithError("LITTER_CPUS must be a CPU list such as 0,2-3.");
+        }
+        if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0) {
+            exitWithError("LITTER_CPUS: could not set the CPU affinity.");
+        }
+    }
+
+    if (const char* env = std::getenv("LITTER_MLOCK"); env && atoi(env)) {
+        // Lock pages as they are faulted in rather than all at once, which would populate every reserved mapping.
+#ifdef MCL_ONFAULT
+        const int flags = MCL_CURRENT | MCL_FUTURE | MCL_ONFAULT;
+#else
+        const int flags = MCL_CURRENT | MCL_FUTURE;
+#endif
+        if (mlockall(flags) != 0) {
+            fprintf(stderr, "[WARNING] LITTER_MLOCK: mlockall failed (%s); check RLIMIT_MEMLOCK.\n",
+                    std::strerror(errno));
+        }
+    }
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+// Reduces run-to-run variance before littering, for litterer-standalone:
+//  - LITTER_STABILIZE=1 re-executes the program with address space layout randomization disabled
+//    (personality(ADDR_NO_RANDOMIZE)), so that every run sees the same heap, stack and library addresses.
+//  - LITTER_CPUS pins the process to a CPU set such as "2,4-7". Threads created later inherit it.
+//  - LITTER_MLOCK=1 locks the process's memory with mlockall, so that none of it is reclaimed during the run.
+// Exits on invalid values. Only returns in the process that goes on to run the program.
+void stabilize();
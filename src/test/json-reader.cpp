@@ -0,0 +1,115 @@
+// Reads a document shaped like detector.out, with escapes, large integers and nested arrays and objects, and checks
+// that malformed documents are rejected.
+
+#include <cstdio>
+#include <cstdlib>
+#include <string_view>
+
+#include "arena.h"
+#include "json-reader.h"
+
+namespace {
+constexpr std::string_view profile = R"({
+	"Bins": [ 0, 0, 12, 3, 0, 1 ],
+	"NAllocations": 16, "Average": 42.5, "MaxLiveAllocations": 9007199254740993,
+	"NReallocs": 5, "NReallocsMoved": 2, "GrowthFactorSteps": 4,
+	"ReallocStartSizes": [ 0, 3, 2 ],
+	"ReallocGrowthFactors": [ 0, 0, 1, 4 ],
+	"ReallocChainLengths": [ 1, 2 ],
+	"AllocationApis": [ "malloc", "calloc", "posix_memalign", "aligned_alloc"],
+	"ApiMix": [[ 10, 2, 0, 0 ], [ 1, 0, 3, 0 ]],
+	"Alignments": [[ 0, 1 ], [ 2, 0 ]],
+	"Phases": [
+		{ "Name": "start", "Start": 0, "NAllocations": 10, "Average": 16, "MaxLiveAllocations": 4, "Bins": [ 0, 10 ] },
+		{ "Name": "load \"db\"\\\tx\u00e9!", "Start": 10, "NAllocations": 6, "Average": 8.25, "MaxLiveAllocations": 5,
+		  "Bins": [ 6 ] }
+	],
+	"Extra": { "true": true, "false": false, "null": null, "negative": -9223372036854775807, "exponent": 1.5e3 }
+}
+)";
+
+constexpr std::string_view malformed[] = {
+    "",
+    "{",
+    "[1, 2",
+    "[1, 2,]",
+    "{\"a\": }",
+    "{\"a\" 1}",
+    "{\"a\": 1,}",
+    "{a: 1}",
+    "\"unterminated",
+    "tru",
+    "nul",
+    "-",
+    "1.2.3",
+    "[1] 2",
+    "{\"a\": 1} }",
+};
+
+int nFailures = 0;
+
+void check(bool condition, const char* what) {
+    if (!condition) {
+        std::fprintf(stderr, "json-reader: %s\n", what);
+        ++nFailures;
+    }
+}
+} // namespace
+
+int main() {
+    Arena arena;
+    const JsonValue* document = parseJson(profile, arena);
+    check(document && document->isObject(), "the profile does not parse");
+    if (!document) {
+        return EXIT_FAILURE;
+    }
+    const JsonValue& data = *document;
+
+    check(data["Bins"].isArray() && data["Bins"].size == 6 && data["Bins"][2].integer == 12, "Bins");
+    check(data["NAllocations"].integer == 16 && data["Average"].number == 42.5, "NAllocations and Average");
+    check(data["MaxLiveAllocations"].integer == 9007199254740993, "integers beyond 2^53 lose precision");
+    check(data["NReallocs"].integer == 5 && data["NReallocsMoved"].integer == 2, "NReallocs");
+    check(data["ReallocStartSizes"][1].integer == 3 && data["ReallocGrowthFactors"][3].integer == 4
+              && data["ReallocChainLengths"].size == 2,
+          "Realloc histograms");
+    check(data["AllocationApis"].size == 4 && data["AllocationApis"][3].string == "aligned_alloc", "AllocationApis");
+    check(data["ApiMix"][1][2].integer == 3 && data["Alignments"][1][0].integer == 2, "nested arrays");
+
+    const JsonValue& phases = data["Phases"];
+    check(phases.isArray() && phases.size == 2, "Phases");
+    check(phases[0]["Name"].string == "start" && phases[1]["Start"].integer == 10
+              && phases[1]["Average"].number == 8.25 && phases[1]["Bins"][0].integer == 6,
+          "phase fields");
+    check(phases[1]["Name"].string == "load \"db\"\\\tx?!", "escapes, with \\u decoded as '?'");
+
+    const JsonValue& extra = data["Extra"];
+    check(extra["true"].type == JsonValue::Type::Boolean && extra["true"].boolean, "true");
+    check(extra["false"].type == JsonValue::Type::Boolean && !extra["false"].boolean, "false");
+    check(extra.contains("null") && extra["null"].isNull(), "null");
+    check(extra["negative"].integer == -9223372036854775807, "large negative integers");
+    check(extra["exponent"].number == 1500, "exponents");
+
+    check(!data.contains("Missing") && data["Missing"]["Deeper"].isNull() && data["Bins"][100].isNull(),
+          "missing keys and indices are not null");
+
+    for (const auto text : malformed) {
+        if (parseJson(text, arena)) {
+            std::fprintf(stderr, "json-reader: accepted malformed \"%.*s\"\n", static_cast<int>(text.size()),
+                         text.data());
+            ++nFailures;
+        }
+    }
+    // The reader stops at 64 levels of nesting, rather than overflowing the stack.
+    char nested[2 * 80];
+    for (const std::size_t depth : {60, 80}) {
+        for (std::size_t i = 0; i < depth; ++i) {
+            nested[i] = '[';
+            nested[depth + i] = ']';
+        }
+        const bool accepted = parseJson(std::string_view(nested, 2 * depth), arena) != nullptr;
+        check(accepted == (depth == 60), accepted ? "nesting beyond the maximum depth is accepted"
+                                                  : "nesting within the maximum depth is rejected");
+    }
+
+    return nFailures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,96 @@
+// Litters twice in one process with the same log file, and checks that the log holds both passes rather than only the
+// last one. Then litters with a second, pre-filled log file, and checks that it was truncated rather than appended to.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <unistd.h>
+
+#include <litterer/litterer.h>
+
+namespace {
+constexpr const char* header = "==================================== Litterer ====";
+constexpr const char* stale = "stale line from an earlier process\n";
+
+int fail(const char* message) {
+    std::fprintf(stderr, "log-passes: %s\n", message);
+    return EXIT_FAILURE;
+}
+
+// Counts the pass headers in the log, and whether any stale line is left.
+std::size_t countHeaders(const char* filename, bool& hasStale) {
+    std::size_t nHeaders = 0;
+    hasStale = false;
+    if (FILE* log = std::fopen(filename, "r")) {
+        char line[1024];
+        while (std::fgets(line, sizeof(line), log)) {
+            nHeaders += std::strncmp(line, header, std::strlen(header)) == 0;
+            hasStale |= std::strcmp(line, stale) == 0;
+        }
+        std::fclose(log);
+    }
+    return nHeaders;
+}
+} // namespace
+
+int main() {
+    char profile[] = "/tmp/log-passes-profile-XXXXXX";
+    char logFilename[] = "/tmp/log-passes-log-XXXXXX";
+    char otherLogFilename[] = "/tmp/log-passes-other-XXXXXX";
+    const int profileFd = mkstemp(profile);
+    const int logFd = mkstemp(logFilename);
+    const int otherLogFd = mkstemp(otherLogFilename);
+    if (profileFd < 0 || logFd < 0 || otherLogFd < 0) {
+        return fail("cannot create temporary files");
+    }
+    close(logFd);
+
+    constexpr const char profileJson[]
+        = R"({"Bins": [0, 0, 100, 100, 100, 100], "MaxLiveAllocations": 200, "NAllocations": 400})";
+    if (write(profileFd, profileJson, sizeof(profileJson) - 1) != sizeof(profileJson) - 1) {
+        return fail("cannot write the profile");
+    }
+    close(profileFd);
+    if (write(otherLogFd, stale, std::strlen(stale)) != static_cast<ssize_t>(std::strlen(stale))) {
+        return fail("cannot pre-fill the second log");
+    }
+    close(otherLogFd);
+
+    litterer::LitterConfig config;
+    config.profile = profile;
+    config.logFilename = logFilename;
+    config.multiplier = 1;
+    config.seed = 1;
+    {
+        litterer::Litter litter(config);
+        litter.run();
+        litter.run();
+        litter.release();
+    }
+
+    config.logFilename = otherLogFilename;
+    {
+        litterer::Litter litter(config);
+        litter.run();
+        litter.release();
+    }
+
+    bool hasStale = false;
+    bool otherHasStale = false;
+    const auto nHeaders = countHeaders(logFilename, hasStale);
+    const auto nOtherHeaders = countHeaders(otherLogFilename, otherHasStale);
+    unlink(profile);
+    unlink(logFilename);
+    unlink(otherLogFilename);
+    if (nHeaders != 2) {
+        std::fprintf(stderr, "log-passes: expected 2 passes in the log, found %zu\n", nHeaders);
+        return EXIT_FAILURE;
+    }
+    if (nOtherHeaders != 1 || otherHasStale) {
+        std::fprintf(stderr, "log-passes: expected 1 pass and no stale lines in the second log, found %zu pass(es)%s\n",
+                     nOtherHeaders, otherHasStale ? " and stale lines" : "");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
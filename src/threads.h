@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+
+#if _WIN32
+#include <thread>
+#include <vector>
+#else
+#include <pthread.h>
+#endif
+
+// Runs f(i) for every i in [0, n) on its own thread, the calling thread taking i = 0, and waits for all of them.
+// pthreads are used directly where available, since std::thread allocates its state with the malloc being littered.
+template <typename F>
+void runOnThreads(unsigned n, F&& f) {
+#if _WIN32
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < n; ++i) {
+        threads.emplace_back([&f, i] { f(i); });
+    }
+    f(0u);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+#else
+    struct Task {
+        F* f;
+        unsigned i;
+    };
+    constexpr unsigned maxThreads = 1024;
+    Task tasks[maxThreads];
+    pthread_t threads[maxThreads];
+
+    if (n > maxThreads) {
+        fprintf(stderr, "[ERROR] Cannot run more than %u threads.\n", maxThreads);
+        exit(EXIT_FAILURE);
+    }
+
+    for (unsigned i = 1; i < n; ++i) {
+        tasks[i] = {&f, i};
+        const auto run = [](void* argument) -> void* {
+            const auto& task = *static_cast<Task*>(argument);
+            (*task.f)(task.i);
+            return nullptr;
+        };
+        if (pthread_create(&threads[i], nullptr, run, &tasks[i]) != 0) {
+            fprintf(stderr, "[ERROR] Could not start thread %u.\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+    f(0u);
+    for (unsigned i = 1; i < n; ++i) {
+        pthread_join(threads[i], nullptr);
+    }
+#endif
+}